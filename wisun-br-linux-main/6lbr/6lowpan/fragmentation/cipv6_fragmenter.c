@@ -27,8 +27,10 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include "common/rand.h"
+#include "common/log.h"
 #include "common/log_legacy.h"
 #include "common/endian.h"
+#include "common/fnv_hash.h"
 #include "common/memutils.h"
 
 #include "net/protocol.h"
@@ -41,75 +43,92 @@
 
 #define TRACE_GROUP "6frg"
 
+#define REASSEMBLY_BUCKET_COUNT 64 // Must be a power of 2
+#define REASSEMBLY_BLOCK_COUNT  256 // 8-byte blocks of the largest datagram (11-bit datagram_size)
+
+// Memory charged to a session, see the buffer_get() in cipv6_frag_reassembly()
+#define REASSEMBLY_SESSION_MEMORY(datagram_size) \
+    (sizeof(buffer_t) + BUFFER_DEFAULT_HEADROOM + 1 + (datagram_size))
+
+static const char *const reassembly_drop_str[REASSEMBLY_DROP_COUNT] = {
+    [REASSEMBLY_DROP_MALFORMED] = "malformed",
+    [REASSEMBLY_DROP_OVERLAP]   = "overlap",
+    [REASSEMBLY_DROP_TOO_LARGE] = "too large",
+    [REASSEMBLY_DROP_EVICTED]   = "evicted",
+    [REASSEMBLY_DROP_TIMEOUT]   = "timeout",
+};
+
 typedef struct reassembly_entry {
     uint16_t ttl;   /*!< Reassembly timer (seconds) */
     uint16_t tag;   /*!< Fragmentation datagram TAG ID */
     uint16_t size;  /*!< Datagram Total Size (uncompressed) */
-    uint16_t orig_size; /*!< Datagram Original Size (compressed) */
-    uint16_t frag_max;  /*!< Maximum fragment size (MAC payload) */
-    uint16_t offset; /*!< Data offset from datagram start */
     int16_t pattern; /*!< Size of compressed LoWPAN headers */
+    uint16_t block_missing; /*!< Number of 8-byte blocks not received yet */
+    uint32_t block_map[REASSEMBLY_BLOCK_COUNT / 32]; /*!< Received 8-byte blocks */
+    uint32_t hash;
     buffer_t *buf;
+    ns_list_link_t      bucket_link; /*!< Hash bucket link entry */
     ns_list_link_t      link; /*!< List link entry */
 } reassembly_entry_t;
 
 typedef NS_LIST_HEAD(reassembly_entry_t, link) reassembly_list_t;
+typedef NS_LIST_HEAD(reassembly_entry_t, bucket_link) reassembly_bucket_t;
 
+/*
+ * Sessions are looked up through a hash of (source, datagram size, tag). The
+ * RX list is kept in least recently updated order, so the session evicted when
+ * the pool or the memory budget is exhausted is the one least likely to
+ * complete.
+ */
 typedef struct reassembly_interface {
     int8_t interface_id;
     uint16_t timeout;
+    size_t memory_limit;
+    size_t memory_used;
     reassembly_list_t rx_list;
     reassembly_list_t free_list;
+    reassembly_bucket_t buckets[REASSEMBLY_BUCKET_COUNT];
+    uint32_t drop_count[REASSEMBLY_DROP_COUNT];
     reassembly_entry_t *entry_pointer_buffer;
     ns_list_link_t      link; /*!< List link entry */
 } reassembly_interface_t;
 
 static NS_LIST_DEFINE(reassembly_interface_list, reassembly_interface_t, link);
 
-
-/* Reassembly structures and helpers - basically the same as in
- * ipv6_fragmentation.c, as we are also using a variation of RFC 815, but there
- * are enough minor differences that it doesn't seem worth trying to share code.
- */
-
-/* We reassemble into the datagram buffer in basically the style of RFC 815 */
-/* An 6-byte hole descriptor is placed directly in buffer holes */
-/* We link them them by buffer offset (relative to start of fragmentable section) */
-/* Note the possible need to align means we can't use more than 7 bytes */
-typedef struct hole {
-    uint16_t first;
-    uint16_t last;
-    uint16_t next;
-} hole_t;
-
-/* Given the offset of a hole in the datagram buffer, return an aligned pointer
- * to put a hole_t in it. We assume a "normal" platform requiring 2-byte
- * alignment for hole_t, and letting us manipulate uintptr_t in the conventional
- * fashion.
+/* Reassembly is still a variation of RFC 815, but RFC 4944 requires all
+ * fragments but the last one to be multiple of 8 bytes, and their offset is
+ * always a multiple of 8. So instead of a hole list, the received data is
+ * tracked with one bit per 8-byte block of the datagram.
  */
-static hole_t *hole_pointer(const buffer_t *buf, uint16_t offset)
+static void reassembly_block_reset(reassembly_entry_t *entry)
 {
-    uintptr_t ptr = (uintptr_t)(buffer_data_pointer(buf) + offset);
+    memset(entry->block_map, 0, sizeof(entry->block_map));
+    entry->block_missing = (entry->size + 7) / 8;
+}
 
-    return (hole_t *)((ptr + 1) & ~(uintptr_t) 1);
+static bool reassembly_block_test(const reassembly_entry_t *entry, uint16_t block)
+{
+    return entry->block_map[block / 32] & (1u << (block % 32));
 }
 
-static void delete_hole(buffer_t *buf, uint16_t hole, uint16_t *prev_ptr)
+static uint16_t reassembly_block_count(const reassembly_entry_t *entry, uint16_t first, uint16_t last)
 {
-    hole_t *hole_ptr = hole_pointer(buf, hole);
+    uint16_t count = 0;
 
-    *prev_ptr = hole_ptr->next;
+    for (uint16_t i = first; i <= last; i++)
+        if (reassembly_block_test(entry, i))
+            count++;
+    return count;
 }
 
-static hole_t *create_hole(buffer_t *buf, uint16_t first, uint16_t last, uint16_t *prev_ptr)
+static void reassembly_block_set(reassembly_entry_t *entry, uint16_t first, uint16_t last)
 {
-    hole_t *hole_ptr = hole_pointer(buf, first);
-    hole_ptr->first = first;
-    hole_ptr->last = last;
-    hole_ptr->next = *prev_ptr;
-
-    *prev_ptr = first;
-    return hole_ptr;
+    for (uint16_t i = first; i <= last; i++) {
+        if (reassembly_block_test(entry, i))
+            continue;
+        entry->block_map[i / 32] |= 1u << (i % 32);
+        entry->block_missing--;
+    }
 }
 
 /*
@@ -211,19 +230,57 @@ static reassembly_interface_t *reassembly_interface_discover(int8_t interfaceId)
     return NULL;
 }
 
+static void reassembly_drop(reassembly_interface_t *interface_ptr, enum reassembly_drop reason)
+{
+    interface_ptr->drop_count[reason]++;
+    TRACE(TR_DROP, "drop %-9s: reassembly %s (%"PRIu32" total)", "6lowpan",
+          reassembly_drop_str[reason], interface_ptr->drop_count[reason]);
+}
+
+const char *reassembly_drop_name(enum reassembly_drop reason)
+{
+    return reassembly_drop_str[reason];
+}
+
+uint32_t reassembly_drop_count(int8_t interface_id, enum reassembly_drop reason)
+{
+    reassembly_interface_t *interface_ptr = reassembly_interface_discover(interface_id);
+
+    return interface_ptr ? interface_ptr->drop_count[reason] : 0;
+}
+
+static reassembly_bucket_t *reassembly_bucket(reassembly_interface_t *interface_ptr, uint32_t hash)
+{
+    return &interface_ptr->buckets[hash & (REASSEMBLY_BUCKET_COUNT - 1)];
+}
+
+static uint32_t reassembly_hash(const buffer_t *buf, uint16_t tag, uint16_t size)
+{
+    uint8_t key[4];
+    uint32_t hash;
+
+    write_be16(key, tag);
+    write_be16(key + 2, size);
+    /* Type will be either long or short 802.15.4 - we skip the PAN ID */
+    hash = fnv_hash_reverse_32_init(buf->src_sa.address + 2, addr_len_from_type(buf->src_sa.addr_type) - 2);
+    return fnv_hash_reverse_32_update(key, sizeof(key), hash);
+}
+
 static void reassembly_entry_free(reassembly_interface_t *interface_ptr, reassembly_entry_t *entry)
 {
+    ns_list_remove(reassembly_bucket(interface_ptr, entry->hash), entry);
     ns_list_remove(&interface_ptr->rx_list, entry);
     ns_list_add_to_start(&interface_ptr->free_list, entry);
+    interface_ptr->memory_used -= REASSEMBLY_SESSION_MEMORY(entry->size);
     if (entry->buf) {
         entry->buf = buffer_free(entry->buf);
     }
 }
 
-static reassembly_entry_t *reassembly_already_action(reassembly_list_t *reassembly_list, buffer_t *buf, uint16_t tag, uint16_t size)
+static reassembly_entry_t *reassembly_already_action(reassembly_interface_t *interface_ptr, buffer_t *buf, uint32_t hash, uint16_t tag, uint16_t size)
 {
-    ns_list_foreach(reassembly_entry_t, reassembly_entry, reassembly_list) {
-        if ((reassembly_entry->tag == tag) && (reassembly_entry->size == size) &&
+    ns_list_foreach(reassembly_entry_t, reassembly_entry, reassembly_bucket(interface_ptr, hash)) {
+        if ((reassembly_entry->hash == hash) && (reassembly_entry->tag == tag) && (reassembly_entry->size == size) &&
                 reassembly_entry->buf->src_sa.addr_type == buf->src_sa.addr_type &&
                 reassembly_entry->buf->dst_sa.addr_type == buf->dst_sa.addr_type) {
             /* Type will be either long or short 802.15.4 - we skip the PAN ID */
@@ -238,17 +295,34 @@ static reassembly_entry_t *reassembly_already_action(reassembly_list_t *reassemb
 
 }
 
-static reassembly_entry_t *lowpan_adaptation_reassembly_get(reassembly_interface_t *interface_ptr)
+static reassembly_entry_t *lowpan_adaptation_reassembly_get(reassembly_interface_t *interface_ptr, uint32_t hash, uint16_t size)
 {
-    reassembly_entry_t *entry = ns_list_get_first(&interface_ptr->free_list);
-    if (!entry) {
+    reassembly_entry_t *entry;
+
+    if (REASSEMBLY_SESSION_MEMORY(size) > interface_ptr->memory_limit) {
+        reassembly_drop(interface_ptr, REASSEMBLY_DROP_TOO_LARGE);
         return NULL;
     }
 
+    // Make room by discarding the least recently updated sessions
+    while (ns_list_is_empty(&interface_ptr->free_list) ||
+           interface_ptr->memory_used + REASSEMBLY_SESSION_MEMORY(size) > interface_ptr->memory_limit) {
+        entry = ns_list_get_first(&interface_ptr->rx_list);
+        BUG_ON(!entry);
+        tr_debug("Reassembly evict: src %s size %u",
+                 trace_sockaddr(&entry->buf->src_sa, true), entry->size);
+        reassembly_entry_free(interface_ptr, entry);
+        reassembly_drop(interface_ptr, REASSEMBLY_DROP_EVICTED);
+    }
+
+    entry = ns_list_get_first(&interface_ptr->free_list);
     ns_list_remove(&interface_ptr->free_list, entry);
     memset(entry, 0, sizeof(reassembly_entry_t));
-    //Add to first
-    ns_list_add_to_start(&interface_ptr->rx_list, entry);
+    entry->hash = hash;
+    entry->size = size;
+    interface_ptr->memory_used += REASSEMBLY_SESSION_MEMORY(size);
+    ns_list_add_to_end(&interface_ptr->rx_list, entry);
+    ns_list_add_to_start(reassembly_bucket(interface_ptr, hash), entry);
 
     return entry;
 }
@@ -263,18 +337,20 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
 
     uint16_t datagram_size, datagram_tag;
     uint16_t fragment_first;
+    uint16_t block_first, block_last, block_count;
     uint8_t frag_header;
+    uint32_t hash;
 
     uint8_t *ptr = buffer_data_pointer(buf);
 
     if (buffer_data_length(buf) < 4)
-        goto reassembly_error;
+        goto reassembly_malformed;
 
     frag_header = ptr[0];
     datagram_size = read_be16(ptr) & 0x07FF;
 
     if (datagram_size == 0) {
-        goto reassembly_error;
+        goto reassembly_malformed;
     }
 
     ptr += 2;
@@ -282,7 +358,7 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
     ptr += 2;
     if (frag_header & LOWPAN_FRAGN_BIT) {
         if (buffer_data_length(buf) < 5)
-            goto reassembly_error;
+            goto reassembly_malformed;
         fragment_first = *ptr++ << 3;
     } else {
         fragment_first = 0;
@@ -292,42 +368,33 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
      * point (we treat FRAGN with offset 0 the same as FRAG1)
      */
     buffer_data_pointer_set(buf, ptr);
-    reassembly_entry_t *frag_ptr = reassembly_already_action(&interface_ptr->rx_list, buf, datagram_tag, datagram_size);
+    hash = reassembly_hash(buf, datagram_tag, datagram_size);
+    reassembly_entry_t *frag_ptr = reassembly_already_action(interface_ptr, buf, hash, datagram_tag, datagram_size);
 
     if (!frag_ptr) {
 
-        frag_ptr = lowpan_adaptation_reassembly_get(interface_ptr);
+        frag_ptr = lowpan_adaptation_reassembly_get(interface_ptr, hash, datagram_size);
         if (!frag_ptr) {
             goto reassembly_error;
         }
 
-        buffer_t *reassembly_buffer = buffer_get(1 + ((datagram_size + 7) & ~7));
-        if (!reassembly_buffer) {
-            //Put allocated back to free
-            reassembly_entry_free(interface_ptr, frag_ptr);
-            goto reassembly_error;
-        }
-
         // Allocate the reassembly buffer.
         // Allow 1 byte extra for an "Uncompressed IPv6" dispatch byte - the
         // 6LoWPAN data can be 1 byte longer than the IPv6 data.
-        // Also, round datagram size up to a multiple of 8 to ensure we have
-        // room for a final hole descriptor (it can spill past the indicated
-        // datagram size if the last fragment is smaller than 8 bytes).
-
+        buffer_t *reassembly_buffer = buffer_get(1 + datagram_size);
         reassembly_buffer->src_sa = buf->src_sa;
         reassembly_buffer->dst_sa = buf->dst_sa;
         frag_ptr->ttl = interface_ptr->timeout;
         frag_ptr->tag = datagram_tag;
-        frag_ptr->size = datagram_size;
         // Set buffer length and adjust start pointer, so it represents the
         // uncompressed IPv6 packet. (See comment block before this function).
         buffer_data_length_set(reassembly_buffer, 1 + datagram_size);
         buffer_data_strip_header(reassembly_buffer, 1);
-        // Write initial hole descriptor into buffer
-        frag_ptr->offset = 0xffff;
-        create_hole(reassembly_buffer, 0, datagram_size - 1, &frag_ptr->offset);
+        reassembly_block_reset(frag_ptr);
         frag_ptr->buf = reassembly_buffer;
+    } else {
+        ns_list_remove(&interface_ptr->rx_list, frag_ptr);
+        ns_list_add_to_end(&interface_ptr->rx_list, frag_ptr);
     }
 
     /* For the first link fragment, work out and remember the "pattern"
@@ -356,67 +423,32 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
     // RFC4944: All link fragments for a datagram except the last one MUST be
     // multiples of eight bytes in length.
     if (ipv6_size % 8 && fragment_last + 1 != datagram_size)
-        goto reassembly_error;
+        goto reassembly_malformed;
     if (fragment_last >= datagram_size) {
         tr_error("Frag out-of-range: last=%u, size=%u", fragment_last, datagram_size);
         //Free Current entry
         reassembly_entry_free(interface_ptr, frag_ptr);
-        goto reassembly_error;
+        goto reassembly_malformed;
     }
 
-    /* Hole-filling algorithm, basically as per RFC 815, but with added
-     * checks for overlap. The hole list is kept sorted, as per
-     * ipv6_fragmentation.c, but that's not relevant in this version.
+    /* We only expect repeat data from retransmission, so fragments should
+     * always lie entirely within missing or existing data, not straddle them.
+     * If we see this happen then junk existing data, making this the first
+     * fragment of a new reassembly (RFC 4944).
      */
-    uint16_t hole_off = frag_ptr->offset;
-    uint16_t *prev_ptr = &frag_ptr->offset;
-    do {
-        hole_t *hole = hole_pointer(frag_ptr->buf, hole_off);
-        uint_fast16_t hole_first = hole->first;
-        uint_fast16_t hole_last = hole->last;
-
-        /* Fragment is beyond this hole - move to next (RFC 815 step 2) */
-        /* Fragment is before this hole - move to next (RFC 815 step 3) */
-        if (fragment_first > hole_last || fragment_last < hole_first) {
-            prev_ptr = &hole->next;
-            hole_off = hole->next;
-            continue;
-        }
-
-        /* If any of the fragment lies outside the hole, it indicates a problem;
-         * we only expect repeat data from retransmission, so fragments should
-         * always lie entirely within a hole or existing data, not straddle
-         * them. If we see this happen then junk existing data, making this the
-         * first fragment of a new reassembly (RFC 4944).
-         */
-        if (fragment_first < hole_first || fragment_last > hole_last) {
-            tr_error("Frag overlap: hole %"PRIuFAST16"-%"PRIuFAST16", frag %"PRIu16"-%"PRIu16, hole_first, hole_last, fragment_first, fragment_last);
-            /* Forget previous data by marking as "all hole" */
-            frag_ptr->offset = 0xffff;
-            create_hole(frag_ptr->buf, hole_off = hole_first = 0, hole_last = datagram_size - 1, prev_ptr = &frag_ptr->offset);
-        }
-
-        /* Unhook this hole from the hole list (RFC 815 step 4) */
-        delete_hole(frag_ptr->buf, hole_off, prev_ptr);
-
-        /* Create a new hole in front if necessary (RFC 815 step 5) */
-        if (fragment_first > hole_first) {
-            prev_ptr = &create_hole(frag_ptr->buf, hole_first, fragment_first - 1, prev_ptr)->next;
-        }
-
-        /* Create a following hole if necessary (RFC 815 step 6) */
-        if (fragment_last < hole_last) {
-            create_hole(frag_ptr->buf, fragment_last + 1, hole_last, prev_ptr);
-        }
-
-        /* Unlike RFC 815, we're now done. We don't allow overlaps, so we finish
-         * as soon as we identify one hole that it entirely or partially fills */
-        break;
-    } while (hole_off != 0xffff);
+    block_first = fragment_first / 8;
+    block_last = fragment_last / 8;
+    block_count = reassembly_block_count(frag_ptr, block_first, block_last);
+    if (block_count && block_count != block_last - block_first + 1) {
+        tr_error("Frag overlap: frag %"PRIu16"-%"PRIu16, fragment_first, fragment_last);
+        reassembly_drop(interface_ptr, REASSEMBLY_DROP_OVERLAP);
+        reassembly_block_reset(frag_ptr);
+    }
+    reassembly_block_set(frag_ptr, block_first, block_last);
 
-    /* Hole list updated, can now copy in the fragment data -  to make sure the
-     * initial fragment goes in the right place we use the end offset, rather
-     * than the start offset. */
+    /* Can now copy in the fragment data -  to make sure the initial fragment
+     * goes in the right place we use the end offset, rather than the start
+     * offset. */
     memcpy(buffer_data_pointer(frag_ptr->buf) + fragment_last + 1 - lowpan_size, buffer_data_pointer(buf), lowpan_size);
 
     /* Combine the "improper security" flags, so reassembled buffer's flag is set if any fragment wasn't secure */
@@ -426,26 +458,28 @@ buffer_t *cipv6_frag_reassembly(int8_t interface_id, buffer_t *buf)
     /* We've finished with the original fragment buffer */
     buf = buffer_free(buf);
 
-    /* Completion check - any holes left? */
-    if (frag_ptr->offset != 0xffff) {
+    /* Completion check - any block left? */
+    if (frag_ptr->block_missing) {
         /* Not yet complete - processing finished on this fragment */
         return NULL;
     }
 
-    /* No more holes, so our reassembly is complete */
+    /* No more missing blocks, so our reassembly is complete */
     buf = frag_ptr->buf;
     frag_ptr->buf = NULL;
+    buf->buf_ptr += frag_ptr->pattern;
     reassembly_entry_free(interface_ptr, frag_ptr);
 
-    /* Buffer start pointer is currently at the "start of uncompressed IPv6
-     * packet" position. Move it either forwards or backwards to match
-     * the IPHC data (could be compressed, or uncompressed with added dispatch
+    /* Buffer start pointer was at the "start of uncompressed IPv6 packet"
+     * position. It has been moved either forwards or backwards to match the
+     * IPHC data (could be compressed, or uncompressed with added dispatch
      * byte).
      */
-    buf->buf_ptr += frag_ptr->pattern;
     buf->info = (buffer_info_t)(B_DIR_UP | B_FROM_FRAGMENTATION | B_TO_IPV6_TXRX);
     return buf;
 
+reassembly_malformed:
+    reassembly_drop(interface_ptr, REASSEMBLY_DROP_MALFORMED);
 reassembly_error:
     return buffer_free(buf);
 }
@@ -460,6 +494,7 @@ static void reassembly_entry_timer_update(reassembly_interface_t *interface_ptr,
                      trace_sockaddr(&reassembly_entry->buf->src_sa, true),
                      reassembly_entry->size);
             reassembly_entry_free(interface_ptr, reassembly_entry);
+            reassembly_drop(interface_ptr, REASSEMBLY_DROP_TIMEOUT);
         }
     }
 }
@@ -481,6 +516,9 @@ int8_t reassembly_interface_free(int8_t interface_id)
 
     ns_list_remove(&reassembly_interface_list, interface_ptr);
 
+    ns_list_foreach_safe(reassembly_entry_t, entry, &interface_ptr->rx_list) {
+        reassembly_entry_free(interface_ptr, entry);
+    }
     //Free Dynamic allocated entry buffer
     free(interface_ptr->entry_pointer_buffer);
     free(interface_ptr);
@@ -488,21 +526,26 @@ int8_t reassembly_interface_free(int8_t interface_id)
     return 0;
 }
 
-void reassembly_interface_init(int8_t interface_id, uint8_t reassembly_session_limit, uint16_t reassembly_timeout)
+void reassembly_interface_init(int8_t interface_id, int reassembly_session_limit,
+                               int reassembly_memory_limit, uint16_t reassembly_timeout)
 {
-    reassembly_interface_t *interface_ptr = zalloc(sizeof(reassembly_interface_t));
-    reassembly_entry_t *reassemply_ptr = zalloc(sizeof(reassembly_entry_t) * reassembly_session_limit);
+    reassembly_interface_t *interface_ptr;
+    reassembly_entry_t *reassemply_ptr;
 
-    BUG_ON(!reassembly_session_limit || !reassembly_timeout);
+    BUG_ON(reassembly_session_limit <= 0 || reassembly_memory_limit <= 0 || !reassembly_timeout);
+    interface_ptr = zalloc(sizeof(reassembly_interface_t));
+    reassemply_ptr = zalloc(sizeof(reassembly_entry_t) * reassembly_session_limit);
     reassembly_interface_free(interface_id);
-    memset(interface_ptr, 0, sizeof(reassembly_interface_t));
     interface_ptr->interface_id = interface_id;
     interface_ptr->timeout = reassembly_timeout;
+    interface_ptr->memory_limit = reassembly_memory_limit;
     interface_ptr->entry_pointer_buffer = reassemply_ptr;
     ns_list_init(&interface_ptr->free_list);
     ns_list_init(&interface_ptr->rx_list);
+    for (int i = 0; i < REASSEMBLY_BUCKET_COUNT; i++)
+        ns_list_init(&interface_ptr->buckets[i]);
 
-    for (uint8_t i = 0; i < reassembly_session_limit ; i++) {
+    for (int i = 0; i < reassembly_session_limit; i++) {
         ns_list_add_to_end(&interface_ptr->free_list, reassemply_ptr);
         reassemply_ptr++;
     }
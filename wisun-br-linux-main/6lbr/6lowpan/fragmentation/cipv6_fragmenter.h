@@ -20,12 +20,26 @@
 #include <stdint.h>
 
 struct buffer;
-void reassembly_interface_init(int8_t interface_id, uint8_t reassembly_session_limit, uint16_t reassembly_timeout);
+
+enum reassembly_drop {
+    REASSEMBLY_DROP_MALFORMED,  // Invalid fragment header, size or offset
+    REASSEMBLY_DROP_OVERLAP,    // Partially overlapping fragment, previous data discarded
+    REASSEMBLY_DROP_TOO_LARGE,  // Datagram larger than the memory budget
+    REASSEMBLY_DROP_EVICTED,    // Oldest session discarded to make room for a new one
+    REASSEMBLY_DROP_TIMEOUT,
+    REASSEMBLY_DROP_COUNT,
+};
+
+void reassembly_interface_init(int8_t interface_id, int reassembly_session_limit,
+                               int reassembly_memory_limit, uint16_t reassembly_timeout);
 int8_t reassembly_interface_free(int8_t interface_id);
 
 void cipv6_frag_timer(int seconds);
 struct buffer *cipv6_frag_reassembly(int8_t interface_id, struct buffer *buf);
 
+const char *reassembly_drop_name(enum reassembly_drop reason);
+uint32_t reassembly_drop_count(int8_t interface_id, enum reassembly_drop reason);
+
 
 
 #endif
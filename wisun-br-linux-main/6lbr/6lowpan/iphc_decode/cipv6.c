@@ -30,6 +30,7 @@
 #include "6lowpan/iphc_decode/cipv6.h"
 #include "6lowpan/iphc_decode/iphc_compress.h"
 #include "6lowpan/iphc_decode/iphc_decompress.h"
+#include "6lowpan/lowpan_adaptation_interface.h"
 
 #define TRACE_GROUP  "iphc"
 
@@ -108,6 +109,7 @@ buffer_t *lowpan_down(buffer_t *buf)
     uint_fast16_t overhead = mac_helper_frame_overhead(cur, buf);
     uint_fast16_t max_iphc_size = mac_helper_max_payload_size(cur, overhead) - 4;
 
+    lowpan_adaptation_tx_classify(buf);
     buf = iphc_compress(&cur->lowpan_contexts, buf, max_iphc_size, stable_only);
     if (!buf) {
         return NULL;
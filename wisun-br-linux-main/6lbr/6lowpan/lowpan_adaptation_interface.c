@@ -20,7 +20,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include "common/endian.h"
+#include "common/fnv_hash.h"
+#include "common/iobuf.h"
 #include "common/rand.h"
+#include "common/time_extra.h"
 #include "common/dhcp_server.h"
 #include "common/log_legacy.h"
 #include "common/ns_list.h"
@@ -28,7 +31,9 @@
 #include "common/memutils.h"
 #include "common/specs/ieee802154.h"
 #include "common/specs/ws.h"
+#include "common/specs/icmpv6.h"
 #include "common/specs/ip.h"
+#include "common/specs/ipv6.h"
 
 #include "common/random_early_detection.h"
 #include "common/events_scheduler.h"
@@ -62,6 +67,73 @@
 
 #define ADAPTION_DIRECT_TX_QUEUE_SIZE_THRESHOLD_TRACE 20
 #define LFN_BUFFER_TIMEOUT_PARAM 4
+#define LOWPAN_TX_DST_TABLE_SIZE 64 // Must be a power of 2
+#define LOWPAN_TX_DRR_QUANTUM 1500  // Bytes, larger than any unfragmented frame
+
+/*
+ * Frames waiting for a free TX process are queued per destination and per
+ * service class. There is a destination for each unicast neighbor (hashed on
+ * its EUI-64), one for broadcast and one for LFN multicast. A queue with
+ * frames whose destination has nothing in flight is linked in the ready list
+ * of its class, so picking the next frame to send does not depend on the
+ * queue depth. Frames of a given class to a given destination are always sent
+ * in order. A queue whose next frame needs fragmentation while all the
+ * fragmentation sessions are in use is moved to a wait list until a session
+ * ends.
+ */
+struct lowpan_tx_dst;
+
+typedef struct lowpan_tx_queue {
+    buffer_list_t frames;
+    uint16_t size;
+    uint8_t tx_class;
+    bool ready: 1;          /*!< Linked in a ready list or in the fragmentation wait list */
+    bool fragment_wait: 1;  /*!< Linked in the fragmentation wait list */
+    struct lowpan_tx_dst *dst;
+    ns_list_link_t link;
+} lowpan_tx_queue_t;
+
+typedef NS_LIST_HEAD(lowpan_tx_queue_t, link) lowpan_tx_ready_list_t;
+
+typedef struct lowpan_tx_dst {
+    uint8_t addr[8];
+    lowpan_tx_queue_t queues[LOWPAN_TX_CLASS_COUNT];
+    uint16_t queue_size; /*!< Frames queued, all classes */
+    bool is_unicast: 1;
+    bool tx_active: 1;  /*!< A frame to this destination waits for its confirmation */
+    ns_list_link_t link; /*!< Destination table link (unicast only) */
+} lowpan_tx_dst_t;
+
+typedef NS_LIST_HEAD(lowpan_tx_dst_t, link) lowpan_tx_dst_list_t;
+
+/*
+ * Network control is always served first. The other classes share the
+ * remaining capacity with deficit round robin, weighted by their quantum.
+ * Each class has its own RED state, with thresholds relative to the limit
+ * computed for the whole adaptation layer queue, so bulk data is dropped well
+ * before it can delay network formation.
+ */
+typedef struct lowpan_tx_class_state {
+    lowpan_tx_ready_list_t unicast_ready_list;
+    lowpan_tx_ready_list_t broadcast_ready_list;
+    struct red_config red;
+    uint16_t queue_size;
+    uint32_t deficit;
+    uint32_t drop_count;
+} lowpan_tx_class_state_t;
+
+static const struct {
+    const char *name;
+    uint16_t quantum;               // 0 for strict priority
+    uint8_t threshold_min_percent;
+    uint8_t threshold_max_percent;
+    uint8_t drop_max_probability;
+} lowpan_tx_class_params[LOWPAN_TX_CLASS_COUNT] = {
+    [LOWPAN_TX_CLASS_CONTROL]   = { "control",   0,                         100, 200, 10 },
+    [LOWPAN_TX_CLASS_EXPEDITED] = { "expedited", 4 * LOWPAN_TX_DRR_QUANTUM,  50, 100, 10 },
+    [LOWPAN_TX_CLASS_DEFAULT]   = { "default",   2 * LOWPAN_TX_DRR_QUANTUM,  50, 100, 10 },
+    [LOWPAN_TX_CLASS_BULK]      = { "bulk",      1 * LOWPAN_TX_DRR_QUANTUM,  25,  50, 20 },
+};
 
 typedef struct fragmenter_tx_entry {
     uint16_t tag;   /*!< Fragmentation datagram TAG ID */
@@ -76,7 +148,9 @@ typedef struct fragmenter_tx_entry {
     bool fragmented_data: 1;
     bool first_fragment: 1;
     bool indirect_data: 1;
+    uint64_t tx_start_ms; /*!< Time of the last request to the MAC */
     buffer_t *buf;
+    lowpan_tx_dst_t *dst;
     uint8_t *fragmenter_buf;
     ns_list_link_t      link; /*!< List link entry */
 } fragmenter_tx_entry_t;
@@ -88,22 +162,29 @@ typedef struct fragmenter_interface {
     int8_t interface_id;
     uint16_t local_frag_tag;
     uint8_t msduHandle;
-    uint8_t *fragment_indirect_tx_buffer; //Used for write fragmentation header
     uint16_t mtu_size;
     fragmenter_tx_entry_t active_broadcast_tx_buf; //Current active direct broadcast tx process
     fragmenter_tx_entry_t active_lfn_broadcast_tx_buf; //Current active direct lfn broadcast tx process
     fragmenter_tx_list_t activeUnicastList; //Unicast packets waiting data confirmation from MAC
-    buffer_list_t directTxQueue; //Waiting free tx process
-    uint16_t directTxQueue_size;
+    lowpan_tx_dst_list_t tx_dst_table[LOWPAN_TX_DST_TABLE_SIZE]; //Unicast destinations waiting free tx process or confirmation
+    lowpan_tx_dst_t broadcast_tx_dst;
+    lowpan_tx_dst_t lfn_broadcast_tx_dst;
+    lowpan_tx_class_state_t tx_class[LOWPAN_TX_CLASS_COUNT];
+    uint8_t tx_class_drr; //Class currently served by deficit round robin
+    lowpan_tx_ready_list_t fragment_wait_list;
+    uint16_t directTxQueue_size; //Frames waiting free tx process, all destinations
+    uint16_t directTxQueue_dst_count; //Destinations with frames waiting free tx process
+    uint32_t tx_latency_ms; //Average delay between a unicast request to an FFN and its confirmation
     uint16_t directTxQueue_level;
     uint16_t activeTxList_size;
-    bool fragmenter_active; /*!< Fragmenter state */
+    uint8_t fragmenter_active_count; /*!< Fragmented TX in progress, at most one per destination */
     mpx_api_t *mpx_api;
     uint16_t mpx_user_id;
     ns_list_link_t      link; /*!< List link entry */
 } fragmenter_interface_t;
 
 #define LOWPAN_ACTIVE_UNICAST_ONGOING_MAX 10
+#define LOWPAN_ACTIVE_FRAGMENTED_ONGOING_MAX 4
 #define LOWPAN_HIGH_PRIORITY_STATE_LENGTH 50 //5 seconds 100us ticks
 
 #define LOWPAN_TX_BUFFER_AGE_LIMIT_LOW_PRIORITY     30 // Remove low priority packets older than limit (seconds)
@@ -116,8 +197,8 @@ static NS_LIST_DEFINE(fragmenter_interface_list, fragmenter_interface_t, link);
 static fragmenter_interface_t *lowpan_adaptation_interface_discover(int8_t interfaceId);
 
 /* Interface direct message pending queue functions */
-static void lowpan_adaptation_tx_queue_write(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf);
-static buffer_t *lowpan_adaptation_tx_queue_read(struct net_if *cur, fragmenter_interface_t *interface_ptr);
+static void lowpan_adaptation_tx_queue_write(struct net_if *cur, fragmenter_interface_t *interface_ptr, lowpan_tx_dst_t *dst, buffer_t *buf);
+static buffer_t *lowpan_adaptation_tx_queue_read(struct net_if *cur, fragmenter_interface_t *interface_ptr, bool *fragmented);
 
 /* Data direction and message length validation */
 static bool lowpan_adaptation_request_longer_than_mtu(struct net_if *cur, buffer_t *buf, fragmenter_interface_t *interface_ptr);
@@ -141,7 +222,7 @@ static int8_t lowpan_message_fragmentation_init(buffer_t *buf, fragmenter_tx_ent
 static bool lowpan_message_fragmentation_message_write(const fragmenter_tx_entry_t *frag_entry, mcps_data_req_t *dataReq);
 static bool lowpan_adaptation_indirect_queue_free_message(struct net_if *cur, fragmenter_interface_t *interface_ptr, fragmenter_tx_entry_t *tx_ptr);
 
-static bool lowpan_buffer_tx_allowed(fragmenter_interface_t *interface_ptr, buffer_t *buf);
+static bool lowpan_buffer_tx_allowed(fragmenter_interface_t *interface_ptr, const lowpan_tx_dst_t *dst, bool fragmented);
 
 static void lowpan_adaptation_interface_data_ind(struct net_if *cur, const mcps_data_ind_t *data_ind);
 static int8_t lowpan_adaptation_interface_tx_confirm(struct net_if *cur, const mcps_data_cnf_t *confirm);
@@ -172,47 +253,334 @@ static struct net_if *lowpan_adaptation_network_interface_discover(const mpx_api
 }
 
 
-static void lowpan_adaptation_tx_queue_level_update(struct net_if *cur, fragmenter_interface_t *interface_ptr)
+static void lowpan_adaptation_tx_queue_level_update(struct net_if *cur, fragmenter_interface_t *interface_ptr, uint8_t tx_class)
 {
     red_aq_calc(&cur->random_early_detection, interface_ptr->directTxQueue_size);
+    red_aq_calc(&interface_ptr->tx_class[tx_class].red, interface_ptr->tx_class[tx_class].queue_size);
 
     if (interface_ptr->directTxQueue_size == interface_ptr->directTxQueue_level + ADAPTION_DIRECT_TX_QUEUE_SIZE_THRESHOLD_TRACE ||
             interface_ptr->directTxQueue_size == interface_ptr->directTxQueue_level - ADAPTION_DIRECT_TX_QUEUE_SIZE_THRESHOLD_TRACE) {
         interface_ptr->directTxQueue_level = interface_ptr->directTxQueue_size;
-        tr_info("Adaptation layer TX queue size %u Active MAC tx request %u", interface_ptr->directTxQueue_level, interface_ptr->activeTxList_size);
+        tr_info("Adaptation layer TX queue size %u (control %u expedited %u default %u bulk %u) Active MAC tx request %u",
+                interface_ptr->directTxQueue_level,
+                interface_ptr->tx_class[LOWPAN_TX_CLASS_CONTROL].queue_size,
+                interface_ptr->tx_class[LOWPAN_TX_CLASS_EXPEDITED].queue_size,
+                interface_ptr->tx_class[LOWPAN_TX_CLASS_DEFAULT].queue_size,
+                interface_ptr->tx_class[LOWPAN_TX_CLASS_BULK].queue_size,
+                interface_ptr->activeTxList_size);
+    }
+}
+
+
+static lowpan_tx_dst_list_t *lowpan_adaptation_tx_dst_bucket(fragmenter_interface_t *interface_ptr, const uint8_t addr[8])
+{
+    return &interface_ptr->tx_dst_table[fnv_hash_reverse_32_init(addr, 8) & (LOWPAN_TX_DST_TABLE_SIZE - 1)];
+}
+
+static lowpan_tx_dst_t *lowpan_adaptation_tx_dst_find(fragmenter_interface_t *interface_ptr, const uint8_t addr[8])
+{
+    ns_list_foreach(lowpan_tx_dst_t, dst, lowpan_adaptation_tx_dst_bucket(interface_ptr, addr)) {
+        if (!memcmp(dst->addr, addr, 8)) {
+            return dst;
+        }
     }
+    return NULL;
 }
 
+static void lowpan_adaptation_tx_dst_init(lowpan_tx_dst_t *dst, bool is_unicast)
+{
+    for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++) {
+        ns_list_init(&dst->queues[i].frames);
+        dst->queues[i].size = 0;
+        dst->queues[i].tx_class = i;
+        dst->queues[i].ready = false;
+        dst->queues[i].fragment_wait = false;
+        dst->queues[i].dst = dst;
+    }
+    dst->queue_size = 0;
+    dst->is_unicast = is_unicast;
+    dst->tx_active = false;
+}
+
+static lowpan_tx_dst_t *lowpan_adaptation_tx_dst_get(fragmenter_interface_t *interface_ptr, const buffer_t *buf)
+{
+    lowpan_tx_dst_t *dst;
+
+    if (!buf->link_specific.ieee802_15_4.requestAck) {
+        if (buf->options.lfn_multicast)
+            return &interface_ptr->lfn_broadcast_tx_dst;
+        else
+            return &interface_ptr->broadcast_tx_dst;
+    }
+
+    dst = lowpan_adaptation_tx_dst_find(interface_ptr, &buf->dst_sa.address[2]);
+    if (dst)
+        return dst;
+    dst = zalloc(sizeof(lowpan_tx_dst_t));
+    memcpy(dst->addr, &buf->dst_sa.address[2], 8);
+    lowpan_adaptation_tx_dst_init(dst, true);
+    ns_list_add_to_start(lowpan_adaptation_tx_dst_bucket(interface_ptr, dst->addr), dst);
+    return dst;
+}
 
-static void lowpan_adaptation_tx_queue_write(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf)
+static void lowpan_adaptation_tx_queue_update(fragmenter_interface_t *interface_ptr, lowpan_tx_queue_t *queue)
 {
-    ns_list_add_to_end(&interface_ptr->directTxQueue, buf);
+    lowpan_tx_class_state_t *tx_class = &interface_ptr->tx_class[queue->tx_class];
+    bool ready = !queue->dst->tx_active && queue->size;
+    lowpan_tx_ready_list_t *ready_list;
+
+    if (queue->fragment_wait)
+        ready_list = &interface_ptr->fragment_wait_list;
+    else if (queue->dst->is_unicast)
+        ready_list = &tx_class->unicast_ready_list;
+    else
+        ready_list = &tx_class->broadcast_ready_list;
+    if (ready && !queue->ready)
+        ns_list_add_to_end(ready_list, queue);
+    if (!ready && queue->ready) {
+        ns_list_remove(ready_list, queue);
+        queue->fragment_wait = false;
+    }
+    queue->ready = ready;
+}
+
+/*
+ * Must be called after any change of the queues or of the TX state of a
+ * destination. Unicast destinations are released when idle, so the pointer
+ * must not be used afterwards.
+ */
+static void lowpan_adaptation_tx_dst_update(fragmenter_interface_t *interface_ptr, lowpan_tx_dst_t *dst)
+{
+    for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++)
+        lowpan_adaptation_tx_queue_update(interface_ptr, &dst->queues[i]);
+
+    if (dst->is_unicast && !dst->tx_active && !dst->queue_size) {
+        ns_list_remove(lowpan_adaptation_tx_dst_bucket(interface_ptr, dst->addr), dst);
+        free(dst);
+    }
+}
+
+static void lowpan_adaptation_tx_queue_write(struct net_if *cur, fragmenter_interface_t *interface_ptr, lowpan_tx_dst_t *dst, buffer_t *buf)
+{
+    ns_list_add_to_end(&dst->queues[buf->tx_class].frames, buf);
+    dst->queues[buf->tx_class].size++;
+    if (!dst->queue_size++)
+        interface_ptr->directTxQueue_dst_count++;
+    interface_ptr->tx_class[buf->tx_class].queue_size++;
     interface_ptr->directTxQueue_size++;
-    lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
+    lowpan_adaptation_tx_dst_update(interface_ptr, dst);
+    lowpan_adaptation_tx_queue_level_update(cur, interface_ptr, buf->tx_class);
 }
 
-static void lowpan_adaptation_tx_queue_write_to_front(struct net_if *cur, fragmenter_interface_t *interface_ptr, buffer_t *buf)
+static void lowpan_adaptation_tx_queue_write_to_front(struct net_if *cur, fragmenter_interface_t *interface_ptr, lowpan_tx_dst_t *dst, buffer_t *buf)
 {
-    ns_list_add_to_start(&interface_ptr->directTxQueue, buf);
+    ns_list_add_to_start(&dst->queues[buf->tx_class].frames, buf);
+    dst->queues[buf->tx_class].size++;
+    if (!dst->queue_size++)
+        interface_ptr->directTxQueue_dst_count++;
+    interface_ptr->tx_class[buf->tx_class].queue_size++;
     interface_ptr->directTxQueue_size++;
-    lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
+    lowpan_adaptation_tx_dst_update(interface_ptr, dst);
+    lowpan_adaptation_tx_queue_level_update(cur, interface_ptr, buf->tx_class);
+}
+
+// Caller must call lowpan_adaptation_tx_dst_update() once done with the destination
+static void lowpan_adaptation_tx_queue_remove(struct net_if *cur, fragmenter_interface_t *interface_ptr, lowpan_tx_queue_t *queue, buffer_t *buf)
+{
+    ns_list_remove(&queue->frames, buf);
+    queue->size--;
+    if (!--queue->dst->queue_size)
+        interface_ptr->directTxQueue_dst_count--;
+    interface_ptr->tx_class[queue->tx_class].queue_size--;
+    interface_ptr->directTxQueue_size--;
+    lowpan_adaptation_tx_queue_level_update(cur, interface_ptr, queue->tx_class);
+}
+
+// Move a ready queue to the fragmentation wait list
+static void lowpan_adaptation_tx_queue_park(fragmenter_interface_t *interface_ptr, lowpan_tx_queue_t *queue)
+{
+    lowpan_tx_class_state_t *tx_class = &interface_ptr->tx_class[queue->tx_class];
+
+    if (queue->dst->is_unicast)
+        ns_list_remove(&tx_class->unicast_ready_list, queue);
+    else
+        ns_list_remove(&tx_class->broadcast_ready_list, queue);
+    ns_list_add_to_end(&interface_ptr->fragment_wait_list, queue);
+    queue->fragment_wait = true;
+}
+
+// A fragmentation session ended, let the waiting queues try again
+static void lowpan_adaptation_fragmenter_release(fragmenter_interface_t *interface_ptr)
+{
+    lowpan_tx_class_state_t *tx_class;
+
+    BUG_ON(!interface_ptr->fragmenter_active_count);
+    interface_ptr->fragmenter_active_count--;
+    ns_list_foreach_safe(lowpan_tx_queue_t, queue, &interface_ptr->fragment_wait_list) {
+        tx_class = &interface_ptr->tx_class[queue->tx_class];
+        ns_list_remove(&interface_ptr->fragment_wait_list, queue);
+        queue->fragment_wait = false;
+        if (queue->dst->is_unicast)
+            ns_list_add_to_end(&tx_class->unicast_ready_list, queue);
+        else
+            ns_list_add_to_end(&tx_class->broadcast_ready_list, queue);
+    }
+}
+
+// Return the queue holding the next frame of a class which can be sent now
+static lowpan_tx_queue_t *lowpan_adaptation_tx_class_peek(struct net_if *cur, fragmenter_interface_t *interface_ptr, uint8_t tx_class)
+{
+    lowpan_tx_class_state_t *state = &interface_ptr->tx_class[tx_class];
+    lowpan_tx_queue_t *queue_unicast;
+    lowpan_tx_queue_t *queue_broadcast;
+    lowpan_tx_queue_t *queue;
+
+    for (;;) {
+        queue_broadcast = ns_list_get_first(&state->broadcast_ready_list);
+        queue_unicast = NULL;
+        if (interface_ptr->activeTxList_size < LOWPAN_ACTIVE_UNICAST_ONGOING_MAX) {
+            queue_unicast = ns_list_get_first(&state->unicast_ready_list);
+        }
+        if (queue_broadcast && queue_unicast) {
+            // Serve the oldest frame first
+            if ((int32_t)(ns_list_get_first(&queue_broadcast->frames)->adaptation_timestamp -
+                          ns_list_get_first(&queue_unicast->frames)->adaptation_timestamp) <= 0) {
+                queue = queue_broadcast;
+            } else {
+                queue = queue_unicast;
+            }
+        } else if (queue_broadcast) {
+            queue = queue_broadcast;
+        } else if (queue_unicast) {
+            queue = queue_unicast;
+        } else {
+            return NULL;
+        }
+
+        if (interface_ptr->fragmenter_active_count < LOWPAN_ACTIVE_FRAGMENTED_ONGOING_MAX ||
+            !lowpan_adaptation_request_longer_than_mtu(cur, ns_list_get_first(&queue->frames), interface_ptr)) {
+            return queue;
+        }
+        lowpan_adaptation_tx_queue_park(interface_ptr, queue);
+    }
+}
+
+static uint8_t lowpan_adaptation_tx_class_drr_next(uint8_t tx_class)
+{
+    do {
+        tx_class = (tx_class + 1) % LOWPAN_TX_CLASS_COUNT;
+    } while (!lowpan_tx_class_params[tx_class].quantum);
+    return tx_class;
+}
+
+static lowpan_tx_queue_t *lowpan_adaptation_tx_class_schedule(struct net_if *cur, fragmenter_interface_t *interface_ptr)
+{
+    lowpan_tx_queue_t *candidates[LOWPAN_TX_CLASS_COUNT];
+    lowpan_tx_class_state_t *state;
+    bool pending = false;
+    uint16_t len;
+    uint8_t i;
+
+    // Strict priority
+    for (i = 0; i < LOWPAN_TX_CLASS_COUNT; i++) {
+        candidates[i] = lowpan_adaptation_tx_class_peek(cur, interface_ptr, i);
+        if (candidates[i] && !lowpan_tx_class_params[i].quantum)
+            return candidates[i];
+        pending |= candidates[i] != NULL;
+    }
+    if (!pending)
+        return NULL;
+
+    // Deficit round robin. The quantum is larger than an unfragmented frame,
+    // so such a frame is picked within two rounds. A class accumulates one
+    // quantum per round, so a longer frame (which will be fragmented) may
+    // need more rounds. The loop ends since at least one class has a frame.
+    i = interface_ptr->tx_class_drr;
+    for (;;) {
+        state = &interface_ptr->tx_class[i];
+        if (!candidates[i]) {
+            state->deficit = 0;
+        } else {
+            len = buffer_data_length(ns_list_get_first(&candidates[i]->frames));
+            if (len <= state->deficit) {
+                state->deficit -= len;
+                interface_ptr->tx_class_drr = i;
+                return candidates[i];
+            }
+        }
+        i = lowpan_adaptation_tx_class_drr_next(i);
+        interface_ptr->tx_class[i].deficit += lowpan_tx_class_params[i].quantum;
+    }
 }
 
-static buffer_t *lowpan_adaptation_tx_queue_read(struct net_if *cur, fragmenter_interface_t *interface_ptr)
+static buffer_t *lowpan_adaptation_tx_queue_read(struct net_if *cur, fragmenter_interface_t *interface_ptr, bool *fragmented)
 {
+    lowpan_tx_queue_t *queue;
+    buffer_t *buf;
+
     // Currently this function is called only when data confirm is received for previously sent packet.
-    if (!interface_ptr->directTxQueue_size) {
+    queue = lowpan_adaptation_tx_class_schedule(cur, interface_ptr);
+    if (!queue) {
         return NULL;
     }
-    ns_list_foreach_safe(buffer_t, buf, &interface_ptr->directTxQueue) {
-        if (lowpan_buffer_tx_allowed(interface_ptr, buf)) {
-            ns_list_remove(&interface_ptr->directTxQueue, buf);
-            interface_ptr->directTxQueue_size--;
-            lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
-            return buf;
+
+    buf = ns_list_get_first(&queue->frames);
+    *fragmented = lowpan_adaptation_request_longer_than_mtu(cur, buf, interface_ptr);
+    lowpan_adaptation_tx_queue_remove(cur, interface_ptr, queue, buf);
+    lowpan_adaptation_tx_dst_update(interface_ptr, queue->dst);
+    return buf;
+}
+
+// Under congestion, drop the oldest frame of the longest destination queue of a class
+static void lowpan_adaptation_tx_queue_drop(struct net_if *cur, fragmenter_interface_t *interface_ptr, uint8_t tx_class)
+{
+    lowpan_tx_queue_t *longest = &interface_ptr->broadcast_tx_dst.queues[tx_class];
+    buffer_t *buf;
+
+    if (interface_ptr->lfn_broadcast_tx_dst.queues[tx_class].size > longest->size) {
+        longest = &interface_ptr->lfn_broadcast_tx_dst.queues[tx_class];
+    }
+    for (int i = 0; i < LOWPAN_TX_DST_TABLE_SIZE; i++) {
+        ns_list_foreach(lowpan_tx_dst_t, dst, &interface_ptr->tx_dst_table[i]) {
+            if (dst->queues[tx_class].size > longest->size) {
+                longest = &dst->queues[tx_class];
+            }
         }
     }
-    return NULL;
+    if (!longest->size) {
+        return;
+    }
+
+    buf = ns_list_get_first(&longest->frames);
+    lowpan_adaptation_tx_queue_remove(cur, interface_ptr, longest, buf);
+    lowpan_adaptation_tx_dst_update(interface_ptr, longest->dst);
+    buffer_free(buf);
+}
+
+static void lowpan_adaptation_tx_queue_free(fragmenter_interface_t *interface_ptr)
+{
+    for (int i = 0; i < LOWPAN_TX_DST_TABLE_SIZE; i++) {
+        ns_list_foreach_safe(lowpan_tx_dst_t, dst, &interface_ptr->tx_dst_table[i]) {
+            ns_list_remove(&interface_ptr->tx_dst_table[i], dst);
+            for (int j = 0; j < LOWPAN_TX_CLASS_COUNT; j++)
+                buffer_free_list(&dst->queues[j].frames);
+            free(dst);
+        }
+    }
+    for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++) {
+        buffer_free_list(&interface_ptr->broadcast_tx_dst.queues[i].frames);
+        buffer_free_list(&interface_ptr->lfn_broadcast_tx_dst.queues[i].frames);
+        ns_list_init(&interface_ptr->tx_class[i].unicast_ready_list);
+        ns_list_init(&interface_ptr->tx_class[i].broadcast_ready_list);
+        interface_ptr->tx_class[i].queue_size = 0;
+        interface_ptr->tx_class[i].deficit = 0;
+    }
+    lowpan_adaptation_tx_dst_init(&interface_ptr->broadcast_tx_dst, false);
+    lowpan_adaptation_tx_dst_init(&interface_ptr->lfn_broadcast_tx_dst, false);
+    ns_list_init(&interface_ptr->fragment_wait_list);
+    interface_ptr->directTxQueue_size = 0;
+    interface_ptr->directTxQueue_dst_count = 0;
+    interface_ptr->directTxQueue_level = 0;
 }
 
 //fragmentation needed
@@ -316,7 +684,15 @@ void lowpan_adaptation_interface_init(int8_t interface_id)
     interface_ptr->msduHandle = rand_get_8bit();
     interface_ptr->local_frag_tag = rand_get_16bit();
 
-    ns_list_init(&interface_ptr->directTxQueue);
+    for (int i = 0; i < LOWPAN_TX_DST_TABLE_SIZE; i++)
+        ns_list_init(&interface_ptr->tx_dst_table[i]);
+    lowpan_adaptation_tx_dst_init(&interface_ptr->broadcast_tx_dst, false);
+    lowpan_adaptation_tx_dst_init(&interface_ptr->lfn_broadcast_tx_dst, false);
+    for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++) {
+        ns_list_init(&interface_ptr->tx_class[i].unicast_ready_list);
+        ns_list_init(&interface_ptr->tx_class[i].broadcast_ready_list);
+    }
+    ns_list_init(&interface_ptr->fragment_wait_list);
     ns_list_init(&interface_ptr->activeUnicastList);
 
     ns_list_add_to_end(&fragmenter_interface_list, interface_ptr);
@@ -332,16 +708,15 @@ int8_t lowpan_adaptation_interface_free(int8_t interface_id)
 
     ns_list_remove(&fragmenter_interface_list, interface_ptr);
     //free active tx process
-    lowpan_list_free(&interface_ptr->activeUnicastList, false);
+    lowpan_list_free(&interface_ptr->activeUnicastList, true);
     interface_ptr->activeTxList_size = 0;
     lowpan_active_buffer_state_reset(&interface_ptr->active_broadcast_tx_buf);
     lowpan_active_buffer_state_reset(&interface_ptr->active_lfn_broadcast_tx_buf);
 
-    buffer_free_list(&interface_ptr->directTxQueue);
-    interface_ptr->directTxQueue_size = 0;
-    interface_ptr->directTxQueue_level = 0;
+    lowpan_adaptation_tx_queue_free(interface_ptr);
     //Free Dynamic allocated entries
-    free(interface_ptr->fragment_indirect_tx_buffer);
+    free(interface_ptr->active_broadcast_tx_buf.fragmenter_buf);
+    free(interface_ptr->active_lfn_broadcast_tx_buf.fragmenter_buf);
     free(interface_ptr);
 
     return 0;
@@ -357,16 +732,14 @@ int8_t lowpan_adaptation_interface_reset(int8_t interface_id)
     }
 
     //free active tx process
-    lowpan_list_free(&interface_ptr->activeUnicastList, false);
+    lowpan_list_free(&interface_ptr->activeUnicastList, true);
     interface_ptr->activeTxList_size  = 0;
     lowpan_active_buffer_state_reset(&interface_ptr->active_broadcast_tx_buf);
     lowpan_active_buffer_state_reset(&interface_ptr->active_lfn_broadcast_tx_buf);
-    //Clean fragmented message flag
-    interface_ptr->fragmenter_active = false;
+    //Clean fragmented message sessions
+    interface_ptr->fragmenter_active_count = 0;
 
-    buffer_free_list(&interface_ptr->directTxQueue);
-    interface_ptr->directTxQueue_size = 0;
-    interface_ptr->directTxQueue_level = 0;
+    lowpan_adaptation_tx_queue_free(interface_ptr);
 
     return 0;
 }
@@ -528,8 +901,9 @@ static fragmenter_tx_entry_t *lowpan_adaptation_tx_process_init(fragmenter_inter
     // For broadcast, the active TX queue is only 1 entry. For unicast, using a list.
     fragmenter_tx_entry_t *tx_entry;
     if (!indirect) {
+        // Each fragmented TX writes its fragments into its own buffer, so several can be in progress
         if (is_unicast) {
-            tx_entry = lowpan_indirect_entry_allocate(0);
+            tx_entry = lowpan_indirect_entry_allocate(fragmented ? interface_ptr->mtu_size : 0);
             if (!tx_entry) {
                 return NULL;
             }
@@ -540,7 +914,8 @@ static fragmenter_tx_entry_t *lowpan_adaptation_tx_process_init(fragmenter_inter
         } else {
             tx_entry = &interface_ptr->active_broadcast_tx_buf;
         }
-        tx_entry->fragmenter_buf = interface_ptr->fragment_indirect_tx_buffer;
+        if (!is_unicast && fragmented && !tx_entry->fragmenter_buf)
+            tx_entry->fragmenter_buf = xalloc(interface_ptr->mtu_size);
     } else {
         if (fragmented) {
             tx_entry = lowpan_indirect_entry_allocate(interface_ptr->mtu_size);
@@ -634,45 +1009,24 @@ static void lowpan_data_request_to_mac(struct net_if *cur, buffer_t *buf, fragme
     }
 
     dataReq.lfn_multicast = buf->options.lfn_multicast;
+    tx_ptr->tx_start_ms = time_now_ms(CLOCK_MONOTONIC);
     interface_ptr->mpx_api->mpx_data_request(interface_ptr->mpx_api, &dataReq, interface_ptr->mpx_user_id);
 }
 
-static bool lowpan_adaptation_is_destination_tx_active(fragmenter_tx_list_t *list, buffer_t *buf)
+static bool lowpan_buffer_tx_allowed(fragmenter_interface_t *interface_ptr, const lowpan_tx_dst_t *dst, bool fragmented)
 {
-    ns_list_foreach(fragmenter_tx_entry_t, entry, list) {
-        if (entry->buf) {
-            if (!memcmp(&entry->buf->dst_sa.address[2], &buf->dst_sa.address[2], 8)) {
-                return true;
-            }
-        }
-    }
-    return false;
-}
-
-static bool lowpan_buffer_tx_allowed(fragmenter_interface_t *interface_ptr, buffer_t *buf)
-{
-    bool is_unicast = buf->link_specific.ieee802_15_4.requestAck;
-
-    // Do not accept any other TX when fragmented TX active. Prevents other frames to be sent in between two fragments.
-    if (interface_ptr->fragmenter_active) {
+    // Do not accept more than one active TX per destination (including broadcast and LFN multicast).
+    // Prevents other frames to be sent to a destination in between two fragments.
+    if (dst->tx_active) {
         return false;
     }
-    // Do not accept more than one active broadcast TX
-    if (!is_unicast) {
-        if (buf->options.lfn_multicast && interface_ptr->active_lfn_broadcast_tx_buf.buf)
-            return false;
-        if (!buf->options.lfn_multicast && interface_ptr->active_broadcast_tx_buf.buf)
-            return false;
-    }
 
-    if (is_unicast && interface_ptr->activeTxList_size >= LOWPAN_ACTIVE_UNICAST_ONGOING_MAX) {
-        //New TX is not possible there is already too manyactive connecting
+    if (fragmented && interface_ptr->fragmenter_active_count >= LOWPAN_ACTIVE_FRAGMENTED_ONGOING_MAX) {
         return false;
     }
 
-
-    // Do not accept more than one active unicast TX per destination
-    if (is_unicast && lowpan_adaptation_is_destination_tx_active(&interface_ptr->activeUnicastList, buf)) {
+    if (dst->is_unicast && interface_ptr->activeTxList_size >= LOWPAN_ACTIVE_UNICAST_ONGOING_MAX) {
+        //New TX is not possible there is already too manyactive connecting
         return false;
     }
     return true;
@@ -701,64 +1055,139 @@ static bool lowpan_adaptation_interface_check_buffer_timeout(struct net_if *cur,
     return buffer_age_s > LOWPAN_TX_BUFFER_AGE_LIMIT_LOW_PRIORITY;
 }
 
-int lowpan_adaptation_queue_size(int8_t interface_id)
+void lowpan_adaptation_tx_class_drops(int8_t interface_id, uint32_t drop_count[LOWPAN_TX_CLASS_COUNT])
 {
     fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(interface_id);
 
-    return interface_ptr->directTxQueue_size;
+    for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++)
+        drop_count[i] = interface_ptr ? interface_ptr->tx_class[i].drop_count : 0;
 }
 
-int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
+const char *lowpan_adaptation_tx_class_name(enum lowpan_tx_class tx_class)
 {
-    if (!buf) {
-        return -1;
-    }
+    return lowpan_tx_class_params[tx_class].name;
+}
 
-    if (!cur) {
-        goto tx_error_handler;
-    }
+void lowpan_adaptation_queue_info(int8_t interface_id, struct lowpan_adaptation_queue_info *info)
+{
+    fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(interface_id);
 
-    fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(cur->id);
     if (!interface_ptr) {
-        goto tx_error_handler;
+        memset(info, 0, sizeof(*info));
+        return;
     }
+    info->size = interface_ptr->directTxQueue_size;
+    info->dst_count = interface_ptr->directTxQueue_dst_count;
+    info->tx_latency_ms = interface_ptr->tx_latency_ms;
+}
 
-    if (!buf->adaptation_timestamp) {
-        // Set TX start timestamp
-        buf->adaptation_timestamp = g_monotonic_time_100ms;
-        if (!buf->adaptation_timestamp) {
-            buf->adaptation_timestamp--;
-        }
-    } else if (lowpan_adaptation_interface_check_buffer_timeout(cur, buf)) {
-        goto tx_error_handler;
+static uint8_t lowpan_adaptation_tx_class_from_dscp(uint8_t dscp)
+{
+    switch (dscp) {
+    case IP_DSCP_CS6:
+    case IP_DSCP_CS7:
+        return LOWPAN_TX_CLASS_CONTROL;
+    case IP_DSCP_EF:
+    case IP_DSCP_VOICE_ADMIT:
+    case IP_DSCP_CS4:
+    case IP_DSCP_AF41:
+    case IP_DSCP_AF42:
+    case IP_DSCP_AF43:
+    case IP_DSCP_CS5:
+        return LOWPAN_TX_CLASS_EXPEDITED;
+    case IP_DSCP_CS1:
+    case IP_DSCP_AF11:
+    case IP_DSCP_AF12:
+    case IP_DSCP_AF13:
+        return LOWPAN_TX_CLASS_BULK;
+    default:
+        return LOWPAN_TX_CLASS_DEFAULT;
     }
+}
 
-    //Check packet size
-    bool fragmented_needed = lowpan_adaptation_request_longer_than_mtu(cur, buf, interface_ptr);
-    if (fragmented_needed) {
-        // If fragmentation TX buffer not allocated, do it now.
-        if (!interface_ptr->fragment_indirect_tx_buffer && !interface_ptr->mtu_size) {
-            interface_ptr->fragment_indirect_tx_buffer = xalloc(cur->mac_parameters.mtu);
-            interface_ptr->mtu_size = cur->mac_parameters.mtu;
+void lowpan_adaptation_tx_classify(buffer_t *buf)
+{
+    struct iobuf_read iobuf = {
+        .data_size = buffer_data_length(buf),
+        .data = buffer_data_pointer(buf),
+    };
+    uint8_t tclass, nh, type;
+    uint16_t port;
+
+    tclass = (iobuf_pop_be16(&iobuf) >> 4) & 0xff;
+    iobuf_pop_data_ptr(&iobuf, IPV6_HDROFF_NH - 2);
+    nh = iobuf_pop_u8(&iobuf);
+    iobuf_pop_data_ptr(&iobuf, IPV6_HDRLEN - IPV6_HDROFF_NH - 1);
+    buf->tx_class = lowpan_adaptation_tx_class_from_dscp((tclass & IP_TCLASS_DSCP_MASK) >> IP_TCLASS_DSCP_SHIFT);
+
+    // Network control is recognized whatever its DSCP, including RPL
+    // tunneled to the final destination
+    while (!iobuf.err) {
+        switch (nh) {
+        case IPV6_NH_HOP_BY_HOP:
+        case IPV6_NH_ROUTING:
+        case IPV6_NH_DEST_OPT:
+            nh = iobuf_pop_u8(&iobuf);
+            iobuf_pop_data_ptr(&iobuf, iobuf_pop_u8(&iobuf) * 8 + 6);
+            break;
+        case IPV6_NH_IPV6:
+            iobuf_pop_data_ptr(&iobuf, IPV6_HDROFF_NH);
+            nh = iobuf_pop_u8(&iobuf);
+            iobuf_pop_data_ptr(&iobuf, IPV6_HDRLEN - IPV6_HDROFF_NH - 1);
+            break;
+        case IPV6_NH_ICMPV6:
+            type = iobuf_pop_u8(&iobuf);
+            if (iobuf.err)
+                return;
+            switch (type) {
+            case ICMPV6_TYPE_RS:
+            case ICMPV6_TYPE_RA:
+            case ICMPV6_TYPE_NS:
+            case ICMPV6_TYPE_NA:
+            case ICMPV6_TYPE_REDIRECT:
+            case ICMPV6_TYPE_RPL:
+            case ICMPV6_TYPE_DAR:
+            case ICMPV6_TYPE_DAC:
+                buf->tx_class = LOWPAN_TX_CLASS_CONTROL;
+                break;
+            }
+            return;
+        case IPV6_NH_UDP:
+            iobuf_pop_be16(&iobuf);
+            port = iobuf_pop_be16(&iobuf);
+            if (!iobuf.err && (port == DHCPV6_SERVER_PORT || port == DHCPV6_CLIENT_PORT))
+                buf->tx_class = LOWPAN_TX_CLASS_CONTROL;
+            return;
+        default:
+            return;
         }
     }
-    bool is_unicast = buf->link_specific.ieee802_15_4.requestAck;
+}
 
-    if (!lowpan_buffer_tx_allowed(interface_ptr, buf)) {
+void lowpan_adaptation_congestion_init(int8_t interface_id, const struct red_config *red)
+{
+    fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(interface_id);
+    struct red_config *class_red;
 
-        if (red_congestion_check(&cur->random_early_detection)) {
-            WARN("congestion detected: dropping oldest packet");
-            // If we need to drop packet we drop oldest normal Priority packet.
-            buffer_t *dropped = ns_list_get_first(&interface_ptr->directTxQueue);
-            if (dropped) {
-                ns_list_remove(&interface_ptr->directTxQueue, dropped);
-                interface_ptr->directTxQueue_size--;
-                buffer_free(dropped);
-            }
-        }
-        lowpan_adaptation_tx_queue_write(cur, interface_ptr, buf);
-        return 0;
+    if (!interface_ptr)
+        return;
+    for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++) {
+        class_red = &interface_ptr->tx_class[i].red;
+        *class_red = *red;
+        class_red->threshold_min = red->threshold_max * lowpan_tx_class_params[i].threshold_min_percent / 100;
+        class_red->threshold_max = red->threshold_max * lowpan_tx_class_params[i].threshold_max_percent / 100;
+        class_red->drop_max_probability = lowpan_tx_class_params[i].drop_max_probability;
+        red_init(class_red);
+        interface_ptr->tx_class[i].drop_count = 0;
+        tr_info("Adaptation layer %s class RED thresholds %u-%u", lowpan_tx_class_params[i].name,
+                class_red->threshold_min, class_red->threshold_max);
     }
+}
+
+static int8_t lowpan_adaptation_interface_tx_start(struct net_if *cur, fragmenter_interface_t *interface_ptr,
+                                                   lowpan_tx_dst_t *dst, buffer_t *buf, bool fragmented_needed)
+{
+    bool is_unicast = buf->link_specific.ieee802_15_4.requestAck;
 
     //Allocate Handle
     buf->seq = lowpan_data_request_unique_handle_get(interface_ptr);
@@ -766,10 +1195,15 @@ int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
     fragmenter_tx_entry_t *tx_ptr = lowpan_adaptation_tx_process_init(interface_ptr, false, fragmented_needed,
                                                                       is_unicast, buf->options.lfn_multicast);
     if (!tx_ptr) {
-        goto tx_error_handler;
+        lowpan_adaptation_tx_dst_update(interface_ptr, dst);
+        buffer_free(buf);
+        return -1;
     }
 
     tx_ptr->buf = buf;
+    tx_ptr->dst = dst;
+    dst->tx_active = true;
+    lowpan_adaptation_tx_dst_update(interface_ptr, dst);
 
     if (fragmented_needed) {
         //Fragmentation init
@@ -779,11 +1213,64 @@ int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
         }
 
         tx_ptr->tag = interface_ptr->local_frag_tag++;
-        interface_ptr->fragmenter_active = true;
+        interface_ptr->fragmenter_active_count++;
     }
 
     lowpan_data_request_to_mac(cur, buf, tx_ptr, interface_ptr);
     return 0;
+}
+
+int8_t lowpan_adaptation_interface_tx(struct net_if *cur, buffer_t *buf)
+{
+    lowpan_tx_dst_t *dst;
+
+    if (!buf) {
+        return -1;
+    }
+
+    if (!cur) {
+        goto tx_error_handler;
+    }
+
+    fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(cur->id);
+    if (!interface_ptr) {
+        goto tx_error_handler;
+    }
+
+    if (!buf->adaptation_timestamp) {
+        // Set TX start timestamp
+        buf->adaptation_timestamp = g_monotonic_time_100ms;
+        if (!buf->adaptation_timestamp) {
+            buf->adaptation_timestamp--;
+        }
+    } else if (lowpan_adaptation_interface_check_buffer_timeout(cur, buf)) {
+        goto tx_error_handler;
+    }
+
+    //Check packet size
+    bool fragmented_needed = lowpan_adaptation_request_longer_than_mtu(cur, buf, interface_ptr);
+    if (fragmented_needed && !interface_ptr->mtu_size) {
+        interface_ptr->mtu_size = cur->mac_parameters.mtu;
+    }
+
+    dst = lowpan_adaptation_tx_dst_get(interface_ptr, buf);
+    // Frames already queued for this destination go through the scheduler first
+    if (dst->queue_size || !lowpan_buffer_tx_allowed(interface_ptr, dst, fragmented_needed)) {
+        lowpan_tx_class_state_t *tx_class = &interface_ptr->tx_class[buf->tx_class];
+
+        if (red_congestion_check(&tx_class->red)) {
+            tx_class->drop_count++;
+            WARN("congestion detected: dropping oldest %s packet (%u dropped)",
+                 lowpan_tx_class_params[buf->tx_class].name, tx_class->drop_count);
+            lowpan_adaptation_tx_queue_drop(cur, interface_ptr, buf->tx_class);
+            // The destination is released if its last frame was dropped
+            dst = lowpan_adaptation_tx_dst_get(interface_ptr, buf);
+        }
+        lowpan_adaptation_tx_queue_write(cur, interface_ptr, dst, buf);
+        return 0;
+    }
+
+    return lowpan_adaptation_interface_tx_start(cur, interface_ptr, dst, buf, fragmented_needed);
 
 tx_error_handler:
     buffer_free(buf);
@@ -824,17 +1311,50 @@ static bool lowpan_adaptation_tx_process_ready(fragmenter_tx_entry_t *tx_ptr)
 
 static void lowpan_adaptation_data_process_clean(fragmenter_interface_t *interface_ptr, fragmenter_tx_entry_t *tx_ptr)
 {
+    lowpan_tx_dst_t *dst = tx_ptr->dst;
     buffer_t *buf = tx_ptr->buf;
 
     tx_ptr->buf = NULL;
+    if (tx_ptr->fragmented_data) {
+        tx_ptr->fragmented_data = false;
+        lowpan_adaptation_fragmenter_release(interface_ptr);
+    }
     if (buf->link_specific.ieee802_15_4.requestAck) {
         ns_list_remove(&interface_ptr->activeUnicastList, tx_ptr);
+        free(tx_ptr->fragmenter_buf);
         free(tx_ptr);
         interface_ptr->activeTxList_size--;
     }
+    dst->tx_active = false;
+    lowpan_adaptation_tx_dst_update(interface_ptr, dst);
     buffer_free(buf);
 }
 
+// Exponentially weighted moving average, 1/8 weight for the new sample
+static void lowpan_adaptation_tx_latency_update(fragmenter_interface_t *interface_ptr, uint64_t latency_ms)
+{
+    if (!interface_ptr->tx_latency_ms)
+        interface_ptr->tx_latency_ms = latency_ms;
+    else
+        interface_ptr->tx_latency_ms = (7 * (uint64_t)interface_ptr->tx_latency_ms + latency_ms) / 8;
+}
+
+/*
+ * The average drives the TUN throttling, so it only tracks direct unicast to
+ * FFNs. A frame to an LFN waits for its unicast listen interval (seconds to
+ * minutes) and would make a single LFN stall all the IPv6 traffic.
+ */
+static bool lowpan_adaptation_tx_latency_relevant(struct net_if *cur, const fragmenter_tx_entry_t *tx_ptr)
+{
+    const buffer_t *buf = tx_ptr->buf;
+    struct ws_neigh *ws_neigh;
+
+    if (!buf->link_specific.ieee802_15_4.requestAck || tx_ptr->indirect_data)
+        return false;
+    ws_neigh = ws_neigh_get(&cur->ws_info.neighbor_storage, buf->dst_sa.address + PAN_ID_LEN);
+    return !ws_neigh || ws_neigh->node_role != WS_NR_ROLE_LFN;
+}
+
 static int8_t lowpan_adaptation_interface_tx_confirm(struct net_if *cur, const mcps_data_cnf_t *confirm)
 {
     uint8_t mlme_status = mlme_status_from_hif(confirm->hif.status);
@@ -869,20 +1389,30 @@ static int8_t lowpan_adaptation_interface_tx_confirm(struct net_if *cur, const m
     }
     buffer_t *buf = tx_ptr->buf;
 
+    if (lowpan_adaptation_tx_latency_relevant(cur, tx_ptr))
+        lowpan_adaptation_tx_latency_update(interface_ptr, time_now_ms(CLOCK_MONOTONIC) - tx_ptr->tx_start_ms);
+
     if (mlme_status == MLME_SUCCESS) {
         //Check is there more packets
         if (lowpan_adaptation_tx_process_ready(tx_ptr)) {
-            if (tx_ptr->fragmented_data && active_direct_confirm)
-                interface_ptr->fragmenter_active = false;
             lowpan_adaptation_data_process_clean(interface_ptr, tx_ptr);
         } else {
             lowpan_data_request_to_mac(cur, buf, tx_ptr, interface_ptr);
         }
     } else if ((buf->link_specific.ieee802_15_4.requestAck) && (mlme_status == MLME_TRANSACTION_EXPIRED)) {
-        lowpan_adaptation_tx_queue_write_to_front(cur, interface_ptr, buf);
+        lowpan_tx_dst_t *dst = tx_ptr->dst;
+
+        if (tx_ptr->fragmented_data) {
+            // Send the whole datagram again
+            buf->buf_ptr = buf->buf_end - tx_ptr->orig_size;
+            lowpan_adaptation_fragmenter_release(interface_ptr);
+        }
         ns_list_remove(&interface_ptr->activeUnicastList, tx_ptr);
+        free(tx_ptr->fragmenter_buf);
         free(tx_ptr);
         interface_ptr->activeTxList_size--;
+        dst->tx_active = false;
+        lowpan_adaptation_tx_queue_write_to_front(cur, interface_ptr, dst, buf);
     } else {
 
 
@@ -900,19 +1430,22 @@ static int8_t lowpan_adaptation_interface_tx_confirm(struct net_if *cur, const m
         if (tx_ptr->fragmented_data) {
             tx_ptr->buf->buf_ptr = tx_ptr->buf->buf_end;
             tx_ptr->buf->buf_ptr -= tx_ptr->orig_size;
-            if (active_direct_confirm) {
-                interface_ptr->fragmenter_active = false;
-            }
         }
 
         lowpan_adaptation_data_process_clean(interface_ptr, tx_ptr);
     }
     // When confirmation is for direct transmission, push all allowed buffers to MAC
     if (active_direct_confirm == true) {
-        buffer_t *buf_from_queue = lowpan_adaptation_tx_queue_read(cur, interface_ptr);
+        bool fragmented;
+        buffer_t *buf_from_queue = lowpan_adaptation_tx_queue_read(cur, interface_ptr, &fragmented);
         while (buf_from_queue) {
-            lowpan_adaptation_interface_tx(cur, buf_from_queue);
-            buf_from_queue = lowpan_adaptation_tx_queue_read(cur, interface_ptr);
+            if (lowpan_adaptation_interface_check_buffer_timeout(cur, buf_from_queue))
+                buffer_free(buf_from_queue);
+            else
+                lowpan_adaptation_interface_tx_start(cur, interface_ptr,
+                                                     lowpan_adaptation_tx_dst_get(interface_ptr, buf_from_queue),
+                                                     buf_from_queue, fragmented);
+            buf_from_queue = lowpan_adaptation_tx_queue_read(cur, interface_ptr, &fragmented);
         }
     }
     return 0;
@@ -1000,6 +1533,21 @@ static bool lowpan_adaptation_indirect_queue_free_message(struct net_if *cur, fr
     return true;
 }
 
+static void lowpan_adaptation_tx_dst_purge(struct net_if *cur, fragmenter_interface_t *interface_ptr, lowpan_tx_dst_t *dst,
+                                           const uint8_t *address_ptr, addrtype_e adr_type)
+{
+    for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++) {
+        ns_list_foreach_safe(buffer_t, entry, &dst->queues[i].frames) {
+            if (lowpan_tx_buffer_address_compare(&entry->dst_sa, address_ptr, adr_type)) {
+                //Update Average QUEUE
+                lowpan_adaptation_tx_queue_remove(cur, interface_ptr, &dst->queues[i], entry);
+                buffer_free(entry);
+            }
+        }
+    }
+    lowpan_adaptation_tx_dst_update(interface_ptr, dst);
+}
+
 int8_t lowpan_adaptation_free_messages_from_queues_by_address(struct net_if *cur, const uint8_t *address_ptr, addrtype_e adr_type)
 {
     fragmenter_interface_t *interface_ptr = lowpan_adaptation_interface_discover(cur->id);
@@ -1016,16 +1564,18 @@ int8_t lowpan_adaptation_free_messages_from_queues_by_address(struct net_if *cur
         }
     }
 
-    //Check next directTxQueue there may be pending packets also
-    ns_list_foreach_safe(buffer_t, entry, &interface_ptr->directTxQueue) {
-        if (lowpan_tx_buffer_address_compare(&entry->dst_sa, address_ptr, adr_type)) {
-            ns_list_remove(&interface_ptr->directTxQueue, entry);
-            interface_ptr->directTxQueue_size--;
-            //Update Average QUEUE
-            lowpan_adaptation_tx_queue_level_update(cur, interface_ptr);
-            buffer_free(entry);
-        }
+    //Check next the destination queues there may be pending packets also
+    if (adr_type == ADDR_802_15_4_LONG) {
+        lowpan_tx_dst_t *dst = lowpan_adaptation_tx_dst_find(interface_ptr, address_ptr);
+
+        if (dst)
+            lowpan_adaptation_tx_dst_purge(cur, interface_ptr, dst, address_ptr, adr_type);
+        return 0;
     }
+    // Destinations are indexed by EUI-64, other addresses need a full scan
+    for (int i = 0; i < LOWPAN_TX_DST_TABLE_SIZE; i++)
+        ns_list_foreach_safe(lowpan_tx_dst_t, dst, &interface_ptr->tx_dst_table[i])
+            lowpan_adaptation_tx_dst_purge(cur, interface_ptr, dst, address_ptr, adr_type);
 
     return 0;
 }
@@ -26,9 +26,23 @@ struct mcps_data_cnf;
 struct mcps_data_ind;
 struct buffer;
 struct mpx_api;
+struct red_config;
 enum buffer_priority;
 typedef enum addrtype addrtype_e;
 
+/*
+ * Service classes of the adaptation layer TX scheduler. Control is served with
+ * strict priority, the other classes share the remaining capacity with
+ * deficit round robin.
+ */
+enum lowpan_tx_class {
+    LOWPAN_TX_CLASS_DEFAULT = 0,
+    LOWPAN_TX_CLASS_CONTROL,    // RPL, ND, DHCPv6, CS6 and CS7
+    LOWPAN_TX_CLASS_EXPEDITED,  // EF, VOICE-ADMIT, CS4, CS5 and AF4x
+    LOWPAN_TX_CLASS_BULK,       // CS1 and AF1x
+    LOWPAN_TX_CLASS_COUNT,
+};
+
 void lowpan_adaptation_interface_init(int8_t interface_id);
 
 int8_t lowpan_adaptation_interface_free(int8_t interface_id);
@@ -37,7 +51,29 @@ int8_t lowpan_adaptation_interface_reset(int8_t interface_id);
 
 int8_t lowpan_adaptation_interface_mpx_register(int8_t interface_id, struct mpx_api *mpx_api, uint16_t mpx_user_id);
 
-int lowpan_adaptation_queue_size(int8_t interface_id);
+struct lowpan_adaptation_queue_info {
+    int size;           // Frames waiting for a TX process
+    int dst_count;      // Destinations with frames waiting for a TX process
+    int tx_latency_ms;  // Average delay between a unicast request to an FFN and its confirmation
+};
+
+void lowpan_adaptation_queue_info(int8_t interface_id, struct lowpan_adaptation_queue_info *info);
+
+/**
+ * \brief Number of frames dropped by the RED of each class, indexed by class
+ */
+void lowpan_adaptation_tx_class_drops(int8_t interface_id, uint32_t drop_count[LOWPAN_TX_CLASS_COUNT]);
+const char *lowpan_adaptation_tx_class_name(enum lowpan_tx_class tx_class);
+
+/**
+ * \brief Derive the per class RED parameters from the adaptation layer ones
+ */
+void lowpan_adaptation_congestion_init(int8_t interface_id, const struct red_config *red);
+
+/**
+ * \brief Set buf->tx_class from the uncompressed IPv6 packet at buffer_data_pointer()
+ */
+void lowpan_adaptation_tx_classify(struct buffer *buf);
 
 /**
  * \brief call this before normal TX. This function prepare buffer link specific metadata and verify packet destination
@@ -44,6 +44,7 @@
 
 #include "commandline_values.h"
 #include "wsbr_cfg.h"
+#include "wsbr_pcapng.h"
 #include "wsbr.h"
 
 #include "commandline.h"
@@ -501,6 +502,8 @@ static void parse_config_line(struct wsbrd_conf *config, struct storage_parse_in
         { "cpc_instance",                  config->cpc_instance,                      conf_set_string,      (void *)sizeof(config->cpc_instance) },
         { "tun_device",                    config->tun_dev,                           conf_set_string,      (void *)sizeof(config->tun_dev) },
         { "tun_autoconf",                  &config->tun_autoconf,                     conf_set_bool,        NULL },
+        { "tun_queue_high",                &config->tun_queue_high,                   conf_set_number,      &valid_positive },
+        { "tun_queue_low",                 &config->tun_queue_low,                    conf_set_number,      &valid_unsigned },
         { "neighbor_proxy",                config->neighbor_proxy,                    conf_set_string,      (void *)sizeof(config->neighbor_proxy) },
         { "user",                          config->user,                              conf_set_string,      (void *)sizeof(config->user) },
         { "group",                         config->group,                             conf_set_string,      (void *)sizeof(config->group) },
@@ -508,6 +511,8 @@ static void parse_config_line(struct wsbrd_conf *config, struct storage_parse_in
         { "use_tap",                       NULL,                                      conf_deprecated,      NULL },
         { "ipv6_prefix",                   &config->ipv6_prefix,                      conf_set_netmask,     NULL },
         { "storage_prefix",                config->storage_prefix,                    conf_set_string,      (void *)sizeof(config->storage_prefix) },
+        { "storage_sync_interval",         &config->storage_sync_interval,            conf_set_number,      &valid_positive },
+        { "use_epoll",                     &config->use_epoll,                        conf_set_bool,        NULL },
         { "trace",                         &g_enabled_traces,                         conf_add_flags,       &valid_traces },
         { "internal_dhcp",                 &config->internal_dhcp,                    conf_set_bool,        NULL },
         { "radius_server",                 &config->radius_server,                    conf_set_netaddr,     NULL },
@@ -560,8 +565,12 @@ static void parse_config_line(struct wsbrd_conf *config, struct storage_parse_in
         { "async_frag_duration",           &config->ws_async_frag_duration,           conf_set_number,      &valid_async_frag_duration },
         { "join_metrics",                  &config->ws_join_metrics,                  conf_set_flags,       &valid_join_metrics },
         { "lowpan_mtu",                    &config->lowpan_mtu,                       conf_set_number,      &valid_lowpan_mtu },
+        { "lowpan_reassembly_sessions",    &config->lowpan_reassembly_sessions,       conf_set_number,      &valid_positive },
+        { "lowpan_reassembly_memory",      &config->lowpan_reassembly_memory,         conf_set_number,      &valid_positive },
         { "pan_size",                      &config->pan_size,                         conf_set_number,      &valid_uint16 },
         { "pcap_file",                     config->pcap_file,                         conf_set_string,      (void *)sizeof(config->pcap_file) },
+        { "pcap_queue_size",               &config->pcap_queue_size,                  conf_set_number,      &valid_positive },
+        { "pcap_overflow",                 &config->pcap_overflow,                    conf_set_enum,        &valid_pcap_overflow },
     };
     int i;
 
@@ -625,6 +634,8 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
     // Keep these values in sync with examples/wsbrd.conf
     config->uart_baudrate = 115200;
     config->tun_autoconf = true;
+    config->tun_queue_high = 8;
+    config->tun_queue_low = 2;
     config->internal_dhcp = true;
     config->ws_class = 0;
     config->ws_domain = REG_DOMAIN_UNDEF;
@@ -639,6 +650,8 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
     config->lfn_bc_sync_period = 5;
     config->bc_dwell_interval = 255;
     config->lowpan_mtu = 2043;
+    config->lowpan_reassembly_sessions = 64;
+    config->lowpan_reassembly_memory = 65536;
     config->ws_pmk_lifetime_s = 172800 * 60;
     config->ws_ptk_lifetime_s = 86400 * 60;
     config->ws_gtk_expire_offset_s = 43200 * 60;
@@ -663,6 +676,9 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
     config->rpl_compat = true;
     config->rpl_rpi_ignorable = false;
     strcpy(config->storage_prefix, "/var/lib/wsbrd/");
+    config->storage_sync_interval = 10;
+    config->pcap_queue_size = 256;
+    config->pcap_overflow = PCAP_OVERFLOW_DROP;
     memset(config->ws_mac_address, 0xff, sizeof(config->ws_mac_address));
     memset(config->ws_allowed_channels, 0xFF, sizeof(config->ws_allowed_channels));
     while ((opt = getopt_long(argc, argv, opts_short, opts_long, NULL)) != -1) {
@@ -821,6 +837,8 @@ void parse_commandline(struct wsbrd_conf *config, int argc, char *argv[],
         FATAL(1, "\"phy_operating_modes\" depends on \"phy_mode_id\"");
     if (config->bc_interval < config->bc_dwell_interval)
         FATAL(1, "broadcast interval %d can't be lower than broadcast dwell interval %d", config->bc_interval, config->bc_dwell_interval);
+    if (config->tun_queue_low >= config->tun_queue_high)
+        FATAL(1, "tun_queue_low %d must be lower than tun_queue_high %d", config->tun_queue_low, config->tun_queue_high);
     if (config->ws_allowed_mac_address_count > 0 && config->ws_denied_mac_address_count > 0)
         FATAL(1, "allowed_mac64 and denied_mac64 are exclusive");
     if (storage_check_access(config->storage_prefix))
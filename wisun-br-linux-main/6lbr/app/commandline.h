@@ -37,6 +37,8 @@ struct wsbrd_conf {
     char tun_dev[IF_NAMESIZE];
     char neighbor_proxy[IF_NAMESIZE];
     bool tun_autoconf;
+    int tun_queue_high;
+    int tun_queue_low;
     bool internal_dhcp;
 
     char ws_name[33]; // null-terminated string of 32 chars
@@ -61,7 +63,9 @@ struct wsbrd_conf {
     char capture[PATH_MAX];
 
     char storage_prefix[PATH_MAX];
+    int  storage_sync_interval;
     bool storage_delete;
+    bool use_epoll;
     bool storage_exit;
     arm_certificate_entry_s tls_own;
     arm_certificate_entry_s tls_ca;
@@ -106,8 +110,12 @@ struct wsbrd_conf {
     uint8_t ws_denied_mac_address_count;
 
     int lowpan_mtu;
+    int lowpan_reassembly_sessions;
+    int lowpan_reassembly_memory;
     int pan_size;
     char pcap_file[PATH_MAX];
+    int pcap_queue_size;
+    int pcap_overflow;
 };
 
 void print_help_br(FILE *stream);
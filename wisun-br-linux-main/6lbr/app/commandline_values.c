@@ -19,6 +19,7 @@
 #include "ws/ws_common_defines.h"
 
 #include "wsbr_cfg.h"
+#include "wsbr_pcapng.h"
 
 #include "commandline_values.h"
 
@@ -113,6 +114,12 @@ const struct name_value valid_tristate[] = {
     { NULL },
 };
 
+const struct name_value valid_pcap_overflow[] = {
+    { "drop",  PCAP_OVERFLOW_DROP },
+    { "block", PCAP_OVERFLOW_BLOCK },
+    { NULL },
+};
+
 const struct name_value valid_booleans[] = {
     { "true",    1 },
     { "false",   0 },
@@ -24,6 +24,7 @@ extern const struct name_value valid_traces[];
 extern const struct name_value valid_join_metrics[];
 extern const struct name_value valid_booleans[];
 extern const struct name_value valid_tristate[];
+extern const struct name_value valid_pcap_overflow[];
 extern const struct name_value valid_ws_regional_regulations[];
 
 #endif
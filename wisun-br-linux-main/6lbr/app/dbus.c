@@ -36,7 +36,10 @@
 #include "ws/ws_llc.h"
 #include "net/protocol.h"
 #include "security/protocols/sec_prot_keys.h"
+#include "6lowpan/fragmentation/cipv6_fragmenter.h"
+#include "6lowpan/lowpan_adaptation_interface.h"
 #include "ipv6/ipv6_routing_table.h"
+#include "net/ns_buffer.h"
 
 #include "commandline_values.h"
 #include "wsbr.h"
@@ -184,24 +187,23 @@ int dbus_leave_multicast_group(sd_bus_message *m, void *userdata, sd_bus_error *
     return 0;
 }
 
+/*
+ * Property change signals are not sent immediately: a burst of RCP
+ * indications or DAOs would otherwise emit the same signal once per frame.
+ * The changes are accumulated and sent by dbus_flush() at the end of the
+ * main loop iteration.
+ */
+enum {
+    DBUS_CHANGE_KEYS          = 1 << 0,
+    DBUS_CHANGE_NODES         = 1 << 1,
+    DBUS_CHANGE_ROUTING_GRAPH = 1 << 2,
+};
+
+static unsigned int dbus_changes;
+
 void dbus_emit_keys_change(struct wsbr_ctxt *ctxt)
 {
-    sd_bus_emit_properties_changed(ctxt->dbus,
-                       "/com/silabs/Wisun/BorderRouter",
-                       "com.silabs.Wisun.BorderRouter",
-                       "Gtks", NULL);
-    sd_bus_emit_properties_changed(ctxt->dbus,
-                       "/com/silabs/Wisun/BorderRouter",
-                       "com.silabs.Wisun.BorderRouter",
-                       "Gaks", NULL);
-    sd_bus_emit_properties_changed(ctxt->dbus,
-                       "/com/silabs/Wisun/BorderRouter",
-                       "com.silabs.Wisun.BorderRouter",
-                       "Lgtks", NULL);
-    sd_bus_emit_properties_changed(ctxt->dbus,
-                       "/com/silabs/Wisun/BorderRouter",
-                       "com.silabs.Wisun.BorderRouter",
-                       "Lgaks", NULL);
+    dbus_changes |= DBUS_CHANGE_KEYS;
 }
 
 static int dbus_get_transient_keys(sd_bus_message *reply, struct net_if *net_if,
@@ -333,6 +335,7 @@ static int dbus_ie_custom_clear(sd_bus_message *m, void *userdata, sd_bus_error
     struct wsbr_ctxt *ctxt = userdata;
 
     ws_ie_custom_clear(&ctxt->net_if.ws_info.ie_custom_list);
+    ws_llc_ie_cache_invalidate(&ctxt->net_if);
     ws_mngt_pan_version_increase(&ctxt->net_if);
     sd_bus_reply_method_return(m, NULL);
     return 0;
@@ -372,6 +375,7 @@ static int dbus_ie_custom_insert(sd_bus_message *m, void *userdata, sd_bus_error
                               content, content_len, frame_type_mask);
     if (ret < 0)
         return sd_bus_error_set_errno(ret_error, -ret);
+    ws_llc_ie_cache_invalidate(&ctxt->net_if);
     ws_mngt_pan_version_increase(&ctxt->net_if);
 
     sd_bus_reply_method_return(m, NULL);
@@ -442,18 +446,39 @@ int dbus_deny_mac64(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
 
 void dbus_emit_nodes_change(struct wsbr_ctxt *ctxt)
 {
-    sd_bus_emit_properties_changed(ctxt->dbus,
-                       "/com/silabs/Wisun/BorderRouter",
-                       "com.silabs.Wisun.BorderRouter",
-                       "Nodes", NULL);
+    dbus_changes |= DBUS_CHANGE_NODES;
 }
 
 void dbus_emit_routing_graph_change(struct wsbr_ctxt *ctxt)
 {
-    sd_bus_emit_properties_changed(ctxt->dbus,
+    dbus_changes |= DBUS_CHANGE_ROUTING_GRAPH;
+}
+
+void dbus_flush(struct wsbr_ctxt *ctxt)
+{
+    char *names[7];
+    int i = 0;
+
+    if (!dbus_changes)
+        return;
+    if (dbus_changes & DBUS_CHANGE_KEYS) {
+        names[i++] = "Gtks";
+        names[i++] = "Gaks";
+        names[i++] = "Lgtks";
+        names[i++] = "Lgaks";
+    }
+    if (dbus_changes & DBUS_CHANGE_NODES)
+        names[i++] = "Nodes";
+    if (dbus_changes & DBUS_CHANGE_ROUTING_GRAPH)
+        names[i++] = "RoutingGraph";
+    names[i] = NULL;
+    dbus_changes = 0;
+    if (!ctxt->dbus)
+        return;
+    sd_bus_emit_properties_changed_strv(ctxt->dbus,
                        "/com/silabs/Wisun/BorderRouter",
                        "com.silabs.Wisun.BorderRouter",
-                       "RoutingGraph", NULL);
+                       names);
 }
 
 static void dbus_message_open_info(sd_bus_message *m, const char *property,
@@ -679,6 +704,49 @@ int dbus_get_routing_graph(sd_bus *bus, const char *path, const char *interface,
     return 0;
 }
 
+int dbus_get_buffer_pools(sd_bus *bus, const char *path, const char *interface,
+                          const char *property, sd_bus_message *reply,
+                          void *userdata, sd_bus_error *ret_error)
+{
+    const struct buffer_pool_stats *stats;
+
+    sd_bus_message_open_container(reply, 'a', "(quuuu)");
+    for (int i = 0; (stats = buffer_pool_stats(i)); i++)
+        sd_bus_message_append(reply, "(quuuu)", stats->size, stats->hits, stats->misses,
+                              stats->in_use, stats->high_water);
+    sd_bus_message_close_container(reply);
+    return 0;
+}
+
+int dbus_get_tx_class_drops(sd_bus *bus, const char *path, const char *interface,
+                            const char *property, sd_bus_message *reply,
+                            void *userdata, sd_bus_error *ret_error)
+{
+    uint32_t drop_count[LOWPAN_TX_CLASS_COUNT];
+    struct wsbr_ctxt *ctxt = userdata;
+
+    lowpan_adaptation_tx_class_drops(ctxt->net_if.id, drop_count);
+    sd_bus_message_open_container(reply, 'a', "(su)");
+    for (int i = 0; i < LOWPAN_TX_CLASS_COUNT; i++)
+        sd_bus_message_append(reply, "(su)", lowpan_adaptation_tx_class_name(i), drop_count[i]);
+    sd_bus_message_close_container(reply);
+    return 0;
+}
+
+int dbus_get_reassembly_drops(sd_bus *bus, const char *path, const char *interface,
+                              const char *property, sd_bus_message *reply,
+                              void *userdata, sd_bus_error *ret_error)
+{
+    struct wsbr_ctxt *ctxt = userdata;
+
+    sd_bus_message_open_container(reply, 'a', "(su)");
+    for (int i = 0; i < REASSEMBLY_DROP_COUNT; i++)
+        sd_bus_message_append(reply, "(su)", reassembly_drop_name(i),
+                              reassembly_drop_count(ctxt->net_if.id, i));
+    sd_bus_message_close_container(reply);
+    return 0;
+}
+
 int dbus_get_hw_address(sd_bus *bus, const char *path, const char *interface,
                         const char *property, sd_bus_message *reply,
                         void *userdata, sd_bus_error *ret_error)
@@ -778,6 +846,12 @@ static const sd_bus_vtable dbus_vtable[] = {
         SD_BUS_PROPERTY("HwAddress", "ay", dbus_get_hw_address,
                         offsetof(struct wsbr_ctxt, rcp.eui64),
                         0),
+        SD_BUS_PROPERTY("BufferPools", "a(quuuu)", dbus_get_buffer_pools, 0,
+                        0),
+        SD_BUS_PROPERTY("TxClassDrops", "a(su)", dbus_get_tx_class_drops, 0,
+                        0),
+        SD_BUS_PROPERTY("ReassemblyDrops", "a(su)", dbus_get_reassembly_drops, 0,
+                        0),
         SD_BUS_PROPERTY("WisunNetworkName", "s", dbus_get_string,
                         offsetof(struct wsbr_ctxt, config.ws_name),
                         SD_BUS_VTABLE_PROPERTY_CONST),
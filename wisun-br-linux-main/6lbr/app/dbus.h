@@ -21,6 +21,7 @@ struct wsbr_ctxt;
 void dbus_emit_keys_change(struct wsbr_ctxt *ctxt);
 void dbus_emit_nodes_change(struct wsbr_ctxt *ctxt);
 void dbus_emit_routing_graph_change(struct wsbr_ctxt *ctxt);
+void dbus_flush(struct wsbr_ctxt *ctxt);
 void dbus_register(struct wsbr_ctxt *ctxt);
 int dbus_get_fd(struct wsbr_ctxt *ctxt);
 int dbus_process(struct wsbr_ctxt *ctxt);
@@ -43,6 +44,11 @@ static inline void dbus_emit_routing_graph_change(struct wsbr_ctxt *ctxt)
     /* empty */
 }
 
+static inline void dbus_flush(struct wsbr_ctxt *ctxt)
+{
+    /* empty */
+}
+
 static inline void dbus_register(struct wsbr_ctxt *ctxt)
 {
     WARN("support for DBus is disabled");
@@ -11,6 +11,8 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <sys/uio.h>
+
 #include "common/bits.h"
 #include "common/capture.h"
 #include "common/endian.h"
@@ -41,6 +43,26 @@ static void rcp_tx(struct rcp *rcp, struct iobuf_write *buf)
     rcp->bus.tx(&rcp->bus, buf->data, buf->len);
 }
 
+// iov[0] must start with the HIF command.
+static void rcp_txv(struct rcp *rcp, const struct iovec *iov, int iovcnt)
+{
+    struct iobuf_write buf = { };
+
+    BUG_ON(!iov[0].iov_len);
+    TRACE(TR_HIF, "hif tx: %s %s%s", hif_cmd_str(((uint8_t *)iov[0].iov_base)[0]),
+          tr_bytes((uint8_t *)iov[0].iov_base + 1, iov[0].iov_len - 1,
+                   NULL, 128, DELIM_SPACE | ELLIPSIS_STAR),
+          iovcnt > 1 ? " ..." : "");
+    if (rcp->bus.txv) {
+        rcp->bus.txv(&rcp->bus, iov, iovcnt);
+        return;
+    }
+    for (int i = 0; i < iovcnt; i++)
+        iobuf_push_data(&buf, iov[i].iov_base, iov[i].iov_len);
+    rcp->bus.tx(&rcp->bus, buf.data, buf.len);
+    iobuf_free(&buf);
+}
+
 static void rcp_ind_nop(struct rcp *rcp, struct iobuf_read *buf)
 {
     BUG_ON(buf->err);
@@ -120,13 +142,20 @@ void rcp_req_data_tx(struct rcp *rcp,
                      const uint32_t frame_counters_min[7],
                      const struct hif_rate_info rate_list[4], uint8_t ms_mode)
 {
-    struct iobuf_write buf = { };
+    // The frame is not copied: the command is sent as a header, the frame
+    // and a trailer. Both buffers are kept to avoid allocations per frame.
+    static struct iobuf_write hdr, buf;
+    struct iovec iov[3];
     int bitfield_offset;
     uint16_t bitfield;
 
-    hif_push_u8(&buf, HIF_CMD_REQ_DATA_TX);
-    hif_push_u8(&buf, handle);
-    hif_push_data(&buf, frame, frame_len);
+    hdr.len = 0;
+    buf.len = 0;
+    hif_push_u8(&hdr, HIF_CMD_REQ_DATA_TX);
+    hif_push_u8(&hdr, handle);
+    iobuf_push_le16(&hdr, frame_len); // See hif_push_data()
+    TRACE(TR_HIF_EXTRA, "hif tx:     data: %s (%d bytes)",
+          tr_bytes(frame, frame_len, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR), frame_len);
 
     bitfield = 0;
     bitfield_offset = buf.len;
@@ -207,8 +236,13 @@ void rcp_req_data_tx(struct rcp *rcp,
     bitfield |= FIELD_PREP(HIF_MASK_MODE_SWITCH_TYPE, ms_mode);
 
     write_le16(buf.data + bitfield_offset, bitfield);
-    rcp_tx(rcp, &buf);
-    iobuf_free(&buf);
+    iov[0].iov_base = hdr.data;
+    iov[0].iov_len  = hdr.len;
+    iov[1].iov_base = (void *)frame;
+    iov[1].iov_len  = frame_len;
+    iov[2].iov_base = buf.data;
+    iov[2].iov_len  = buf.len;
+    rcp_txv(rcp, iov, ARRAY_SIZE(iov));
 }
 
 void rcp_req_data_tx_abort(struct rcp *rcp, uint8_t handle)
@@ -527,6 +561,20 @@ struct rcp_cmd rcp_cmd_table[] = {
     { 0 }
 };
 
+/*
+ * Direct lookup from the command byte. The entries point into rcp_cmd_table
+ * so handlers replaced at startup (see wsbrd-fuzz) are still honored. Built
+ * on the first reception since rcp_cmd_table may be modified before.
+ */
+static struct rcp_cmd *rcp_cmd_index[256];
+
+static void rcp_cmd_index_init(void)
+{
+    for (struct rcp_cmd *cmd = rcp_cmd_table; cmd->fn; cmd++)
+        if (!rcp_cmd_index[cmd->cmd])
+            rcp_cmd_index[cmd->cmd] = cmd;
+}
+
 static bool rcp_init_state_is_valid(struct rcp *rcp, uint8_t cmd)
 {
     if (!rcp->has_reset)
@@ -536,14 +584,14 @@ static bool rcp_init_state_is_valid(struct rcp *rcp, uint8_t cmd)
     return true;
 }
 
-void rcp_rx(struct rcp *rcp)
+static bool rcp_rx_frame(struct rcp *rcp)
 {
     struct iobuf_read buf = { .data = rcp_rx_buf };
     uint32_t cmd;
 
     buf.data_size = rcp->bus.rx(&rcp->bus, rcp_rx_buf, sizeof(rcp_rx_buf));
     if (!buf.data_size)
-        return;
+        return false;
     capture_record_hif(buf.data, buf.data_size);
     cmd = hif_pop_u8(&buf);
     if (cmd == 0xff)
@@ -554,10 +602,21 @@ void rcp_rx(struct rcp *rcp)
                        NULL, 128, DELIM_SPACE | ELLIPSIS_STAR));
     if (!rcp_init_state_is_valid(rcp, cmd)) {
         TRACE(TR_DROP, "drop %-9s: unexpected command during reset sequence", "hif");
-        return;
+        return true;
+    }
+    if (rcp_cmd_index[cmd]) {
+        rcp_cmd_index[cmd]->fn(rcp, &buf);
+        return true;
     }
-    for (int i = 0; i < ARRAY_SIZE(rcp_cmd_table); i++)
-        if (rcp_cmd_table[i].cmd == cmd)
-            return rcp_cmd_table[i].fn(rcp, &buf);
     TRACE(TR_DROP, "drop %-9s: unsupported command 0x%02x", "hif", cmd);
+    return true;
+}
+
+// Process all the frames already received by the UART bus
+void rcp_rx(struct rcp *rcp)
+{
+    if (!rcp_cmd_index[HIF_CMD_IND_RESET])
+        rcp_cmd_index_init();
+    while (rcp_rx_frame(rcp) && rcp->bus.uart.data_ready)
+        ;
 }
@@ -24,6 +24,7 @@
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 #include <netlink/netlink.h>
+#include <netlink/msg.h>
 #include <netlink/route/link.h>
 #include <netlink/route/addr.h>
 #include <netlink/route/route.h>
@@ -34,7 +35,9 @@
 #include "common/capture.h"
 #include "common/log.h"
 #include "common/endian.h"
+#include "common/hash_table.h"
 #include "common/iobuf.h"
+#include "common/memutils.h"
 #include "common/netinet_in_extra.h"
 #include "common/specs/icmpv6.h"
 
@@ -50,6 +53,8 @@
 #define IPV6_TRAFFIC_CLASS_MASK 0b00001111111100000000000000000000
 #define IPV6_FLOW_LABEL_MASK    0b00000000000011111111111111111111
 
+#define TUN_FRAME_SIZE_MAX 1504 // Max ethernet frame size + TUN header
+
 ssize_t wsbr_tun_write(uint8_t *buf, uint16_t len)
 {
     struct wsbr_ctxt *ctxt = &g_ctxt;
@@ -111,75 +116,256 @@ int tun_addr_get_global_unicast(const char *if_name, uint8_t ip[16])
     return tun_addr_get(if_name, ip, true, false);
 }
 
-void tun_add_node_to_proxy_neightbl(struct net_if *if_entry, const uint8_t address[16])
+/*
+ * Proxy neighbors and direct routes are pushed to the kernel through a single
+ * non-blocking netlink socket. Requests issued during a main loop iteration
+ * are concatenated and sent at once by tun_nl_flush(), and the ACKs are
+ * processed from the main loop. A local mirror of what has been installed
+ * avoids sending (and dumping the kernel tables for) duplicate requests.
+ *
+ * The kernel processes the requests and queues the ACKs synchronously within
+ * nl_sendto(), so they are drained right after each send. Batches are limited
+ * in number of messages so their ACKs always fit in the receive buffer.
+ * Kernel deletions are followed through the neighbor and route multicast
+ * groups. If the receive buffer overruns anyway, notifications may have been
+ * lost and the mirror is dropped.
+ */
+#define TUN_NL_BATCH_MSG_MAX   16
+#define TUN_NL_RCVBUF_SIZE     (256 * 1024)
+
+enum {
+    TUN_NL_PROXY_NEIGH = 0x01,
+    TUN_NL_DIRECT_ROUTE = 0x02,
+};
+
+struct tun_nl_entry {
+    uint8_t addr[16];
+    uint8_t flags;
+};
+
+static const void *tun_nl_mirror_key(const void *entry)
 {
-    struct wsbr_ctxt *ctxt = &g_ctxt;
-    struct rtnl_neigh *nl_neigh;
-    struct nl_addr *src_ipv6_nl_addr;
-    struct nl_cache *cache;
+    return ((const struct tun_nl_entry *)entry)->addr;
+}
+
+static const struct hash_table_type tun_nl_mirror_type = {
+    .key     = tun_nl_mirror_key,
+    .key_len = 16,
+};
+
+static struct {
     struct nl_sock *sock;
-    int ifindex, err;
+    struct nl_cb *cb;
+    int proxy_ifindex;
+    int tun_ifindex;
+    struct hash_table mirror;
+    uint8_t batch[8192];
+    size_t batch_len;
+    int batch_count;
+} g_tun_nl;
+
+static struct tun_nl_entry *tun_nl_mirror_get(const uint8_t addr[16])
+{
+    struct tun_nl_entry *entry;
+
+    entry = hash_table_get(&g_tun_nl.mirror, &tun_nl_mirror_type, addr);
+    if (!entry) {
+        entry = zalloc(sizeof(struct tun_nl_entry));
+        memcpy(entry->addr, addr, 16);
+        hash_table_insert(&g_tun_nl.mirror, &tun_nl_mirror_type, entry);
+    }
+    return entry;
+}
+
+static void tun_nl_mirror_forget(const uint8_t addr[16], uint8_t flag)
+{
+    struct tun_nl_entry *entry;
+
+    entry = hash_table_get(&g_tun_nl.mirror, &tun_nl_mirror_type, addr);
+    if (!entry || !(entry->flags & flag))
+        return;
+    TRACE(TR_TUN, "tun: kernel removed %s %s", flag == TUN_NL_PROXY_NEIGH ? "proxy" : "route", tr_ipv6(addr));
+    entry->flags &= ~flag;
+    if (!entry->flags) {
+        hash_table_remove(&g_tun_nl.mirror, &tun_nl_mirror_type, entry);
+        free(entry);
+    }
+}
+
+static void tun_nl_mirror_clear(void)
+{
+    struct tun_nl_entry *entry;
+
+    hash_table_foreach(&g_tun_nl.mirror, entry, i)
+        free(entry);
+    hash_table_clear(&g_tun_nl.mirror);
+}
+
+static void tun_nl_batch(struct nl_msg *msg)
+{
+    struct nlmsghdr *hdr;
+
+    nl_complete_msg(g_tun_nl.sock, msg); // Also requests an ACK
+    hdr = nlmsg_hdr(msg);
+    BUG_ON(NLMSG_ALIGN(hdr->nlmsg_len) > sizeof(g_tun_nl.batch));
+    if (g_tun_nl.batch_len + NLMSG_ALIGN(hdr->nlmsg_len) > sizeof(g_tun_nl.batch) ||
+        g_tun_nl.batch_count >= TUN_NL_BATCH_MSG_MAX)
+        tun_nl_flush();
+    memcpy(g_tun_nl.batch + g_tun_nl.batch_len, hdr, hdr->nlmsg_len);
+    g_tun_nl.batch_len += NLMSG_ALIGN(hdr->nlmsg_len);
+    g_tun_nl.batch_count++;
+    nlmsg_free(msg);
+}
+
+void tun_nl_flush(void)
+{
+    int err;
+
+    if (!g_tun_nl.batch_len)
+        return;
+    err = nl_sendto(g_tun_nl.sock, g_tun_nl.batch, g_tun_nl.batch_len);
+    FATAL_ON(err < 0, 2, "%s: nl_sendto: %s", __func__, nl_geterror(err));
+    g_tun_nl.batch_len = 0;
+    g_tun_nl.batch_count = 0;
+    // The ACKs are already queued, do not let them pile up with the next batch
+    tun_nl_recv();
+}
+
+static int tun_nl_err_cb(struct sockaddr_nl *nla, struct nlmsgerr *e, void *arg)
+{
+    if (e->error != -EEXIST)
+        WARN("tun: netlink request %d: %s", e->msg.nlmsg_type, strerror(-e->error));
+    // Keep processing the ACKs of the rest of the batch
+    return NL_SKIP;
+}
+
+static int tun_nl_valid_cb(struct nl_msg *msg, void *arg)
+{
+    struct nlmsghdr *hdr = nlmsg_hdr(msg);
+    struct nlattr *attr;
+    struct rtmsg *rtm;
+    struct ndmsg *ndm;
+
+    if (hdr->nlmsg_type == RTM_DELNEIGH && nlmsg_valid_hdr(hdr, sizeof(*ndm))) {
+        ndm = nlmsg_data(hdr);
+        attr = nlmsg_find_attr(hdr, sizeof(*ndm), NDA_DST);
+        if (ndm->ndm_family == AF_INET6 && ndm->ndm_ifindex == g_tun_nl.proxy_ifindex &&
+            (ndm->ndm_flags & NTF_PROXY) && attr && nla_len(attr) == 16)
+            tun_nl_mirror_forget(nla_data(attr), TUN_NL_PROXY_NEIGH);
+    } else if (hdr->nlmsg_type == RTM_DELROUTE && nlmsg_valid_hdr(hdr, sizeof(*rtm))) {
+        rtm = nlmsg_data(hdr);
+        attr = nlmsg_find_attr(hdr, sizeof(*rtm), RTA_OIF);
+        if (rtm->rtm_family != AF_INET6 || rtm->rtm_dst_len != 128 ||
+            !attr || nla_get_u32(attr) != (uint32_t)g_tun_nl.tun_ifindex)
+            return NL_SKIP;
+        attr = nlmsg_find_attr(hdr, sizeof(*rtm), RTA_DST);
+        if (attr && nla_len(attr) == 16)
+            tun_nl_mirror_forget(nla_data(attr), TUN_NL_DIRECT_ROUTE);
+    }
+    return NL_SKIP;
+}
+
+void tun_nl_recv(void)
+{
+    int err;
+
+    for (;;) {
+        // nl_recvmsgs_report() returns 0 once the socket is drained
+        do
+            err = nl_recvmsgs_report(g_tun_nl.sock, g_tun_nl.cb);
+        while (err > 0);
+        if (err != -NLE_NOMEM)
+            break;
+        // Deletions may have been missed, the next additions are resent
+        WARN("tun: netlink receive buffer overrun, dropping the mirror");
+        tun_nl_mirror_clear();
+    }
+    FATAL_ON(err < 0, 2, "%s: %s", __func__, nl_geterror(err));
+}
+
+int tun_nl_get_fd(void)
+{
+    return g_tun_nl.sock ? nl_socket_get_fd(g_tun_nl.sock) : -1;
+}
+
+static void tun_nl_init(struct wsbr_ctxt *ctxt)
+{
+    int err;
 
     if (strlen(ctxt->config.neighbor_proxy) == 0)
         return;
 
-    ifindex = if_nametoindex(ctxt->config.neighbor_proxy);
-    if (!ifindex) {
+    g_tun_nl.proxy_ifindex = if_nametoindex(ctxt->config.neighbor_proxy);
+    if (!g_tun_nl.proxy_ifindex) {
         ERROR("if_nametoindex %s: %m", ctxt->config.neighbor_proxy);
         return;
     }
-
-    sock = nl_socket_alloc();
-    BUG_ON(!sock);
-    err = nl_connect(sock, NETLINK_ROUTE);
+    g_tun_nl.sock = nl_socket_alloc();
+    BUG_ON(!g_tun_nl.sock);
+    err = nl_connect(g_tun_nl.sock, NETLINK_ROUTE);
     FATAL_ON(err < 0, 2, "nl_connect: %s", nl_geterror(err));
+    err = nl_socket_set_nonblocking(g_tun_nl.sock);
+    FATAL_ON(err < 0, 2, "nl_socket_set_nonblocking: %s", nl_geterror(err));
+    err = nl_socket_set_buffer_size(g_tun_nl.sock, TUN_NL_RCVBUF_SIZE, 0);
+    FATAL_ON(err < 0, 2, "nl_socket_set_buffer_size: %s", nl_geterror(err));
+    err = nl_socket_add_memberships(g_tun_nl.sock, RTNLGRP_NEIGH, RTNLGRP_IPV6_ROUTE, 0);
+    FATAL_ON(err < 0, 2, "nl_socket_add_memberships: %s", nl_geterror(err));
+    // Messages are sent with nl_sendto(), bypassing the sequence tracking
+    nl_socket_disable_seq_check(g_tun_nl.sock);
+    nl_socket_modify_cb(g_tun_nl.sock, NL_CB_VALID, NL_CB_CUSTOM, tun_nl_valid_cb, NULL);
+    nl_socket_modify_err_cb(g_tun_nl.sock, NL_CB_CUSTOM, tun_nl_err_cb, NULL);
+    g_tun_nl.cb = nl_socket_get_cb(g_tun_nl.sock);
+}
+
+void tun_add_node_to_proxy_neightbl(struct net_if *if_entry, const uint8_t address[16])
+{
+    struct tun_nl_entry *entry;
+    struct rtnl_neigh *nl_neigh;
+    struct nl_addr *src_ipv6_nl_addr;
+    struct nl_msg *msg;
+    int err;
+
+    if (!g_tun_nl.sock)
+        return;
+
+    entry = tun_nl_mirror_get(address);
+    if (entry->flags & TUN_NL_PROXY_NEIGH)
+        return;
+    entry->flags |= TUN_NL_PROXY_NEIGH;
 
-    err = rtnl_neigh_alloc_cache(sock, &cache);
-    FATAL_ON(err < 0, 2, "rtnl_neigh_alloc_cache: %s", nl_geterror(err));
     src_ipv6_nl_addr = nl_addr_build(AF_INET6, address, 16);
     FATAL_ON(!src_ipv6_nl_addr, 2, "nl_addr_build: %s", strerror(ENOMEM));
-    nl_neigh = rtnl_neigh_get(cache, ifindex, src_ipv6_nl_addr);
-    nl_cache_put(cache);
-    if (nl_neigh)
-        goto cleanup;
     nl_neigh = rtnl_neigh_alloc();
     BUG_ON(!nl_neigh);
 
-    rtnl_neigh_set_ifindex(nl_neigh, ifindex);
+    rtnl_neigh_set_ifindex(nl_neigh, g_tun_nl.proxy_ifindex);
     rtnl_neigh_set_dst(nl_neigh, src_ipv6_nl_addr);
     rtnl_neigh_set_flags(nl_neigh, NTF_PROXY);
     rtnl_neigh_set_flags(nl_neigh, NTF_ROUTER);
-    err = rtnl_neigh_add(sock, nl_neigh, NLM_F_CREATE);
-    FATAL_ON(err < 0, 2, "rtnl_neigh_add: %s", nl_geterror(err));
+    err = rtnl_neigh_build_add_request(nl_neigh, NLM_F_CREATE, &msg);
+    FATAL_ON(err < 0, 2, "rtnl_neigh_build_add_request: %s", nl_geterror(err));
+    tun_nl_batch(msg);
 
-cleanup:
     rtnl_neigh_put(nl_neigh);
     nl_addr_put(src_ipv6_nl_addr);
-    nl_socket_free(sock);
 }
 
 void tun_add_ipv6_direct_route(struct net_if *if_entry, const uint8_t address[16])
 {
-    struct wsbr_ctxt *ctxt = &g_ctxt;
+    struct tun_nl_entry *entry;
     struct rtnl_nexthop* nl_nexthop;
     struct rtnl_route *nl_route;
     struct nl_addr *ipv6_nl_addr;
-    struct nl_sock *sock;
-    int ifindex, err;
+    struct nl_msg *msg;
+    int err;
 
-    if (strlen(ctxt->config.neighbor_proxy) == 0)
+    if (!g_tun_nl.sock)
         return;
 
-    ifindex = if_nametoindex(ctxt->config.tun_dev);
-    if (!ifindex) {
-        ERROR("if_nametoindex %s: %m", ctxt->config.tun_dev);
+    entry = tun_nl_mirror_get(address);
+    if (entry->flags & TUN_NL_DIRECT_ROUTE)
         return;
-    }
-
-    sock = nl_socket_alloc();
-    BUG_ON(!sock);
-    err = nl_connect(sock, NETLINK_ROUTE);
-    FATAL_ON(err < 0, 2, "nl_connect: %s", nl_geterror(err));
+    entry->flags |= TUN_NL_DIRECT_ROUTE;
 
     ipv6_nl_addr = nl_addr_build(AF_INET6, address, 16);
     FATAL_ON(!ipv6_nl_addr, 2, "nl_addr_build: %s", strerror(ENOMEM));
@@ -191,15 +377,14 @@ void tun_add_ipv6_direct_route(struct net_if *if_entry, const uint8_t address[16
     rtnl_route_set_iif(nl_route, AF_INET6);
     err = rtnl_route_set_dst(nl_route, ipv6_nl_addr);
     FATAL_ON(err < 0, 2, "rtnl_route_set_dst: %s", nl_geterror(err));
-    rtnl_route_nh_set_ifindex(nl_nexthop, ifindex);
+    rtnl_route_nh_set_ifindex(nl_nexthop, g_tun_nl.tun_ifindex);
     rtnl_route_add_nexthop(nl_route, nl_nexthop);
-    err = rtnl_route_add(sock, nl_route, 0);
-    if (err < 0 && err != -NLE_EXIST)
-        FATAL(2, "rtnl_route_add: %s", nl_geterror(err));
+    err = rtnl_route_build_add_request(nl_route, NLM_F_CREATE, &msg);
+    FATAL_ON(err < 0, 2, "rtnl_route_build_add_request: %s", nl_geterror(err));
+    tun_nl_batch(msg);
 
     rtnl_route_put(nl_route);
     nl_addr_put(ipv6_nl_addr);
-    nl_socket_free(sock);
 }
 
 static void tun_addr_add(struct nl_sock *sock, int ifindex, const uint8_t ipv6_prefix[8], const uint8_t hw_mac_addr[8], bool register_proxy_ndp)
@@ -370,9 +555,14 @@ int wsbr_tun_leave_mcast_group(int sock_mcast, const char *if_name, const uint8_
 
 void wsbr_tun_init(struct wsbr_ctxt *ctxt)
 {
+    tun_nl_init(ctxt);
     ctxt->tun_fd = wsbr_tun_open(ctxt->config.tun_dev, ctxt->rcp.eui64,
                                  ctxt->config.ipv6_prefix, ctxt->config.tun_autoconf,
                                  strlen(ctxt->config.neighbor_proxy));
+    if (g_tun_nl.sock) {
+        g_tun_nl.tun_ifindex = if_nametoindex(ctxt->config.tun_dev);
+        FATAL_ON(!g_tun_nl.tun_ifindex, 2, "if_nametoindex %s: %m", ctxt->config.tun_dev);
+    }
     // It is also possible to use Netlink interface through DEVCONF_ACCEPT_RA
     // but this API is not mapped in libnl-route.
     wsbr_sysctl_set("/proc/sys/net/ipv6/conf", ctxt->config.tun_dev, "accept_ra", '0');
@@ -399,32 +589,38 @@ static bool is_icmpv6_type_supported_by_wisun(uint8_t iv6t)
         return false;
 }
 
-void wsbr_tun_read(struct wsbr_ctxt *ctxt)
+bool wsbr_tun_read(struct wsbr_ctxt *ctxt)
 {
-    uint8_t buf[1504]; // Max ethernet frame size + TUN header
-    struct iobuf_read iobuf = { .data = buf };
+    struct iobuf_read iobuf = { };
     uint8_t ip_version, nxthdr;
     buffer_t *buf_6lowpan;
+    ssize_t len;
     uint8_t type;
 
-    iobuf.data_size = xread(ctxt->tun_fd, buf, sizeof(buf));
-    if (iobuf.data_size < 0) {
-        WARN("%s: read: %m", __func__);
-        return;
+    // Read straight into the buffer_t to avoid a copy of each packet
+    buf_6lowpan = buffer_get_minimal(TUN_FRAME_SIZE_MAX);
+    if (!buf_6lowpan)
+        FATAL(1,"could not allocate tun buffer_t");
+    len = xread(ctxt->tun_fd, buffer_data_pointer(buf_6lowpan), TUN_FRAME_SIZE_MAX);
+    if (len < 0) {
+        if (errno != EAGAIN)
+            WARN("%s: read: %m", __func__);
+        buffer_free(buf_6lowpan);
+        return false;
     }
+    buffer_data_end_set(buf_6lowpan, buffer_data_end(buf_6lowpan) + len);
+    iobuf.data = buffer_data_pointer(buf_6lowpan);
+    iobuf.data_size = len;
     TRACE(TR_TUN, "rx-tun: %i bytes", iobuf.data_size);
 
     ip_version = FIELD_GET(IPV6_VERSION_MASK, iobuf_pop_be32(&iobuf));
     if (ip_version != 6) {
         TRACE(TR_DROP, "drop %-9s: unsupported IPv%u", "tun", ip_version);
-        return;
+        buffer_free(buf_6lowpan);
+        return true;
     }
 
-    buf_6lowpan = buffer_get_minimal(iobuf.data_size);
-    if (!buf_6lowpan)
-        FATAL(1,"could not allocate tun buffer_t");
     buf_6lowpan->interface = &ctxt->net_if;
-    buffer_data_add(buf_6lowpan, iobuf.data, iobuf.data_size);
 
     iobuf_pop_be16(&iobuf); /* Payload length */
     nxthdr                         = iobuf_pop_u8(&iobuf);
@@ -438,7 +634,7 @@ void wsbr_tun_read(struct wsbr_ctxt *ctxt)
         if(!addr_am_group_member_on_interface(&ctxt->net_if, buf_6lowpan->dst_sa.address)) {
             TRACE(TR_DROP, "drop %-9s: unsupported dst=%s", "tun", tr_ipv6(buf_6lowpan->dst_sa.address));
             buffer_free(buf_6lowpan);
-            return;
+            return true;
         }
         if (!memcmp(buf_6lowpan->dst_sa.address, ADDR_ALL_MPL_FORWARDERS, 16))
             buf_6lowpan->options.mpl_fwd_workaround = true;
@@ -452,10 +648,11 @@ void wsbr_tun_read(struct wsbr_ctxt *ctxt)
         if (!is_icmpv6_type_supported_by_wisun(type)) {
             TRACE(TR_DROP, "drop %-9s: unsupported ICMPv6 type %u", "tun", type);
             buffer_free(buf_6lowpan);
-            return;
+            return true;
         }
     }
 
     buf_6lowpan->info = (buffer_info_t)(B_DIR_DOWN | B_FROM_IPV6_FWD | B_TO_IPV6_FWD);
     protocol_push(buf_6lowpan);
+    return true;
 }
@@ -13,6 +13,7 @@
  */
 #ifndef TUN_H
 #define TUN_H
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -20,13 +21,17 @@ struct wsbr_ctxt;
 struct net_if;
 
 void wsbr_tun_init(struct wsbr_ctxt *ctxt);
-void wsbr_tun_read(struct wsbr_ctxt *ctxt);
+// Return false if no packet could be read
+bool wsbr_tun_read(struct wsbr_ctxt *ctxt);
 int tun_addr_get_link_local(const char *if_name, uint8_t ip[16]);
 int tun_addr_get_global_unicast(const char *if_name, uint8_t ip[16]);
 int wsbr_tun_join_mcast_group(int sock_mcast, const char *if_name, const uint8_t mcast_group[16]);
 int wsbr_tun_leave_mcast_group(int sock_mcast, const char *if_name, const uint8_t mcast_group[16]);
 ssize_t wsbr_tun_write(uint8_t *buf, uint16_t len);
 
+int tun_nl_get_fd(void);
+void tun_nl_recv(void);
+void tun_nl_flush(void);
 void tun_add_node_to_proxy_neightbl(struct net_if *if_entry, const uint8_t address[16]);
 void tun_add_ipv6_direct_route(struct net_if *if_entry, const uint8_t address[16]);
 
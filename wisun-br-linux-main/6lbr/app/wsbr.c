@@ -13,6 +13,11 @@
  */
 #define _GNU_SOURCE
 #include <netinet/in.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
@@ -33,8 +38,10 @@
 #include "common/string_extra.h"
 #include "common/specs/ws.h"
 #include "common/rand.h"
+#include "common/time_extra.h"
 
 #include "6lowpan/bootstraps/protocol_6lowpan.h"
+#include "6lowpan/fragmentation/cipv6_fragmenter.h"
 #include "6lowpan/lowpan_adaptation_interface.h"
 #include "6lowpan/mac/mac_helper.h"
 #include "ws/ws_pan_info_storage.h"
@@ -88,7 +95,6 @@ struct wsbr_ctxt g_ctxt = {
     // avoid initializating to 0 = STDIN_FILENO
     .timerfd = -1,
     .tun_fd = -1,
-    .pcapng_fd = -1,
     .rcp.bus.fd = -1,
     .dhcp_server.fd = -1,
     .net_if.rpl_root.sockfd = -1,
@@ -425,6 +431,8 @@ static void wsbr_network_init(struct wsbr_ctxt *ctxt)
     protocol_core_init();
     address_module_init();
     protocol_init(&ctxt->net_if, &ctxt->rcp, ctxt->config.lowpan_mtu);
+    reassembly_interface_init(ctxt->net_if.id, ctxt->config.lowpan_reassembly_sessions,
+                              ctxt->config.lowpan_reassembly_memory, 5);
     ret = ws_bootstrap_init(ctxt->net_if.id);
     BUG_ON(ret);
 
@@ -470,13 +478,43 @@ static void wsbr_handle_reset(struct rcp *rcp)
         FATAL(3, "RCP API < 2.0.0 (too old)");
 }
 
-void kill_handler(int signal)
+// The atexit() handlers (storage sync, capture) are not async-signal-safe, so
+// the termination signals are blocked and received through a signalfd. The
+// main loop then exits on their behalf.
+static bool wsbr_exit_requested;
+
+static void wsbr_signal_init(struct wsbr_ctxt *ctxt)
 {
-    struct wsbr_ctxt *ctxt = &g_ctxt;
+    sigset_t sigmask;
+
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGINT);
+    sigaddset(&sigmask, SIGHUP);
+    sigaddset(&sigmask, SIGTERM);
+    // Also inherited by the threads created later
+    FATAL_ON(sigprocmask(SIG_BLOCK, &sigmask, NULL) < 0, 2, "sigprocmask: %m");
+    ctxt->signal_fd = signalfd(-1, &sigmask, SFD_NONBLOCK | SFD_CLOEXEC);
+    FATAL_ON(ctxt->signal_fd < 0, 2, "signalfd: %m");
+}
 
-    if (ctxt->config.uart_dev[0])
-        uart_tx_flush(&ctxt->rcp.bus);
-    exit(0);
+static void wsbr_signal_process(struct wsbr_ctxt *ctxt)
+{
+    struct signalfd_siginfo info;
+    sigset_t sigmask;
+    ssize_t ret;
+
+    ret = read(ctxt->signal_fd, &info, sizeof(info));
+    if (ret < 0 && errno == EAGAIN)
+        return;
+    FATAL_ON(ret < 0, 2, "%s: read: %m", __func__);
+    INFO("%s, exiting", strsignal(info.ssi_signo));
+    wsbr_exit_requested = true;
+    // A second signal kills the process if the exit gets stuck
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGINT);
+    sigaddset(&sigmask, SIGHUP);
+    sigaddset(&sigmask, SIGTERM);
+    sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
 }
 
 void sig_error_handler(int signal)
@@ -486,12 +524,38 @@ void sig_error_handler(int signal)
     raise(signal);
 }
 
+// Process the RCP frames until *done is set, and leave if asked to in the
+// meantime.
+static void wsbr_rcp_wait(struct wsbr_ctxt *ctxt, const bool *done)
+{
+    struct pollfd pfd[2] = {
+        { .events = POLLIN },
+        { .fd = ctxt->signal_fd, .events = POLLIN },
+    };
+    int ret;
+
+    while (!*done) {
+        if (!ctxt->rcp.bus.uart.data_ready) {
+            // The bus fd may change (ie. replayed captures)
+            pfd[0].fd = ctxt->rcp.bus.fd;
+            ret = poll(pfd, 2, -1);
+            FATAL_ON(ret < 0, 2, "%s poll: %m", __func__);
+            if (pfd[1].revents & POLLIN)
+                wsbr_signal_process(ctxt);
+            if (wsbr_exit_requested)
+                exit(0);
+            if (!(pfd[0].revents & (POLLIN | POLLERR)))
+                continue;
+        }
+        rcp_rx(&ctxt->rcp);
+    }
+}
+
 static void wsbr_rcp_init(struct wsbr_ctxt *ctxt)
 {
     rcp_set_host_api(&ctxt->rcp, version_daemon_api);
     rcp_req_radio_list(&ctxt->rcp);
-    while (!ctxt->rcp.has_rf_list)
-        rcp_rx(&ctxt->rcp);
+    wsbr_rcp_wait(ctxt, &ctxt->rcp.has_rf_list);
 
     if (ctxt->config.list_rf_configs) {
         rail_print_config_list(ctxt);
@@ -513,6 +577,7 @@ static void wsbr_rcp_reset(struct wsbr_ctxt *ctxt)
         ctxt->rcp.bus.fd = uart_open(ctxt->config.uart_dev, ctxt->config.uart_baudrate, ctxt->config.uart_rtscts);
         ctxt->rcp.version_api  = VERSION(2, 0, 0); // default assumed version
         ctxt->rcp.bus.tx    = uart_tx;
+        ctxt->rcp.bus.txv   = uart_txv;
         ctxt->rcp.bus.rx    = uart_rx;
         rcp_req_reset(&ctxt->rcp, false);
     } else if (ctxt->config.cpc_instance[0]) {
@@ -534,8 +599,7 @@ static void wsbr_rcp_reset(struct wsbr_ctxt *ctxt)
     WARN_ON(!ret, "RCP is not responding");
 
     ctxt->rcp.bus.uart.init_phase = true;
-    while (!ctxt->rcp.has_reset)
-        rcp_rx(&ctxt->rcp);
+    wsbr_rcp_wait(ctxt, &ctxt->rcp.has_reset);
     ctxt->rcp.bus.uart.init_phase = false;
 }
 
@@ -563,6 +627,63 @@ static void wsbr_fds_init(struct wsbr_ctxt *ctxt)
     ctxt->fds[POLLFD_PAE_AUTH].events = POLLIN;
     ctxt->fds[POLLFD_RADIUS].fd = kmp_socket_if_get_radius_sockfd();
     ctxt->fds[POLLFD_RADIUS].events = POLLIN;
+    ctxt->fds[POLLFD_NETLINK].fd = tun_nl_get_fd();
+    ctxt->fds[POLLFD_NETLINK].events = POLLIN;
+    ctxt->fds[POLLFD_SIGNAL].fd = ctxt->signal_fd;
+    ctxt->fds[POLLFD_SIGNAL].events = POLLIN;
+}
+
+// Queuing delay above which the TUN device is not read anymore
+#define WSBR_TUN_QUEUE_DELAY_MAX_MS 2000
+
+/*
+ * Back-pressure on the TUN device. The head of each destination queue is sent
+ * as soon as the destination is free, so only the frames queued behind it are
+ * counted against the watermarks. The delay a new frame would wait behind this
+ * backlog is estimated from the average confirmation latency of unicast frames
+ * to FFNs, to avoid building a long standing queue when the radio is slow.
+ * The number of packets admitted per wakeup is the room left below the high
+ * watermark.
+ */
+static void wsbr_tun_throttle(struct wsbr_ctxt *ctxt, bool wakeup)
+{
+    struct wsbr_tun_throttle *throttle = &ctxt->tun_throttle;
+    struct lowpan_adaptation_queue_info info;
+    uint64_t now_ms = time_now_ms(CLOCK_MONOTONIC);
+    int backlog, delay_ms;
+
+    lowpan_adaptation_queue_info(ctxt->net_if.id, &info);
+    backlog = info.size - info.dst_count;
+    delay_ms = info.dst_count ? backlog * info.tx_latency_ms / info.dst_count : 0;
+
+    if (!throttle->throttled &&
+        (backlog >= ctxt->config.tun_queue_high || delay_ms > WSBR_TUN_QUEUE_DELAY_MAX_MS)) {
+        throttle->throttled = true;
+        throttle->throttle_start_ms = now_ms;
+        throttle->throttle_count++;
+    } else if (throttle->throttled &&
+               backlog <= ctxt->config.tun_queue_low && delay_ms <= WSBR_TUN_QUEUE_DELAY_MAX_MS / 2) {
+        throttle->throttled = false;
+        throttle->throttled_ms += now_ms - throttle->throttle_start_ms;
+        TRACE(TR_TUN, "tun: resume after %"PRIu64"ms (throttled %u times, %"PRIu64"ms total)",
+              now_ms - throttle->throttle_start_ms, throttle->throttle_count, throttle->throttled_ms);
+    }
+
+    if (throttle->throttled)
+        throttle->admit = 0;
+    else if (wakeup || throttle->admit > ctxt->config.tun_queue_high - backlog)
+        throttle->admit = MAX(ctxt->config.tun_queue_high - backlog, 1);
+    ctxt->fds[POLLFD_TUN].events = throttle->admit > 0 ? POLLIN : 0;
+}
+
+static bool wsbr_tun_rx(struct wsbr_ctxt *ctxt)
+{
+    if (!wsbr_tun_read(ctxt))
+        return false;
+    ctxt->tun_throttle.admit--;
+    // Stop reading as soon as the queues are full enough
+    wsbr_tun_throttle(ctxt, false);
+    return ctxt->tun_throttle.admit > 0;
 }
 
 static void wsbr_poll(struct wsbr_ctxt *ctxt)
@@ -570,15 +691,14 @@ static void wsbr_poll(struct wsbr_ctxt *ctxt)
     uint64_t val;
     int ret;
 
-    if (lowpan_adaptation_queue_size(ctxt->net_if.id) > 2)
-        ctxt->fds[POLLFD_TUN].events = 0;
-    else
-        ctxt->fds[POLLFD_TUN].events = POLLIN;
+    wsbr_tun_throttle(ctxt, true);
 
     if (ctxt->rcp.bus.uart.data_ready)
         ret = poll(ctxt->fds, POLLFD_COUNT, 0);
     else
         ret = poll(ctxt->fds, POLLFD_COUNT, -1);
+    if (ret < 0 && errno == EINTR)
+        return;
     FATAL_ON(ret < 0, 2, "poll: %m");
 
     if (ctxt->fds[POLLFD_DBUS].revents & POLLIN)
@@ -596,7 +716,7 @@ static void wsbr_poll(struct wsbr_ctxt *ctxt)
     if (ctxt->fds[POLLFD_RADIUS].revents & POLLIN)
         kmp_socket_if_radius_socket_cb(ctxt->fds[POLLFD_RADIUS].fd);
     if (ctxt->fds[POLLFD_TUN].revents & POLLIN)
-        wsbr_tun_read(ctxt);
+        wsbr_tun_rx(ctxt);
     if (ctxt->fds[POLLFD_EVENT].revents & POLLIN) {
         read(ctxt->scheduler.event_fd[0], &val, sizeof(val));
         WARN_ON(val != 'W');
@@ -608,8 +728,198 @@ static void wsbr_poll(struct wsbr_ctxt *ctxt)
         rcp_rx(&ctxt->rcp);
     if (ctxt->fds[POLLFD_TIMER].revents & POLLIN)
         wsbr_common_timer_process(ctxt);
-    if (ctxt->fds[POLLFD_PCAP].revents & POLLERR)
-        wsbr_pcapng_closed(ctxt);
+    if (ctxt->fds[POLLFD_NETLINK].revents & POLLIN)
+        tun_nl_recv();
+    if (ctxt->fds[POLLFD_SIGNAL].revents & POLLIN)
+        wsbr_signal_process(ctxt);
+    tun_nl_flush();
+    dbus_flush(ctxt);
+    storage_flush();
+}
+
+static bool wsbr_event_rx(struct wsbr_ctxt *ctxt)
+{
+    uint64_t val;
+
+    read(ctxt->scheduler.event_fd[0], &val, sizeof(val));
+    WARN_ON(val != 'W');
+    event_scheduler_run_until_idle();
+    return false;
+}
+
+static bool wsbr_dbus_rx(struct wsbr_ctxt *ctxt)
+{
+    dbus_process(ctxt);
+    return false;
+}
+
+static bool wsbr_timer_rx(struct wsbr_ctxt *ctxt)
+{
+    wsbr_common_timer_process(ctxt);
+    return false;
+}
+
+static bool wsbr_dhcp_rx(struct wsbr_ctxt *ctxt)
+{
+    return dhcp_recv(&ctxt->dhcp_server);
+}
+
+static bool wsbr_rpl_rx(struct wsbr_ctxt *ctxt)
+{
+    return rpl_recv(&ctxt->net_if.rpl_root);
+}
+
+static bool wsbr_br_eapol_relay_rx(struct wsbr_ctxt *ctxt)
+{
+    return ws_eapol_relay_socket_cb(ctxt->fds[POLLFD_BR_EAPOL_RELAY].fd);
+}
+
+static bool wsbr_eapol_relay_rx(struct wsbr_ctxt *ctxt)
+{
+    return ws_eapol_auth_relay_socket_cb(ctxt->fds[POLLFD_EAPOL_RELAY].fd);
+}
+
+static bool wsbr_pae_auth_rx(struct wsbr_ctxt *ctxt)
+{
+    return kmp_socket_if_pae_socket_cb(ctxt->fds[POLLFD_PAE_AUTH].fd);
+}
+
+static bool wsbr_radius_rx(struct wsbr_ctxt *ctxt)
+{
+    return kmp_socket_if_radius_socket_cb(ctxt->fds[POLLFD_RADIUS].fd);
+}
+
+static bool wsbr_rcp_rx(struct wsbr_ctxt *ctxt)
+{
+    rcp_rx(&ctxt->rcp);
+    // The UART is blocking, only the frames already received can be served
+    return ctxt->rcp.bus.uart.data_ready;
+}
+
+static bool wsbr_netlink_rx(struct wsbr_ctxt *ctxt)
+{
+    tun_nl_recv();
+    return false;
+}
+
+static bool wsbr_signal_rx(struct wsbr_ctxt *ctxt)
+{
+    wsbr_signal_process(ctxt);
+    return false;
+}
+
+/*
+ * With use_epoll, a source whose handler returned true is served again, up to
+ * budget times per wakeup. The ready sources are served in a round robin
+ * fashion, so a busy source cannot starve the others. The sources which consume
+ * their whole input at once have a budget of 1.
+ *
+ * The fds of the other sources are switched to non-blocking, so their handlers
+ * return false on EAGAIN instead of the loop polling them again. The RCP is the
+ * exception: its handler only asks to be called again while the bus has
+ * buffered data.
+ */
+static const struct {
+    bool (*rx)(struct wsbr_ctxt *ctxt);
+    uint32_t events;
+    int budget;
+} wsbr_sources[POLLFD_COUNT] = {
+    [POLLFD_TUN]             = { wsbr_tun_rx,               EPOLLIN,            16 },
+    [POLLFD_RCP]             = { wsbr_rcp_rx,               EPOLLIN | EPOLLERR, 16 },
+    [POLLFD_DBUS]            = { wsbr_dbus_rx,              EPOLLIN,             1 },
+    [POLLFD_EVENT]           = { wsbr_event_rx,             EPOLLIN,             1 },
+    [POLLFD_TIMER]           = { wsbr_timer_rx,             EPOLLIN,             1 },
+    [POLLFD_DHCP_SERVER]     = { wsbr_dhcp_rx,              EPOLLIN,             4 },
+    [POLLFD_RPL]             = { wsbr_rpl_rx,               EPOLLIN,             4 },
+    [POLLFD_BR_EAPOL_RELAY]  = { wsbr_br_eapol_relay_rx,    EPOLLIN,             4 },
+    [POLLFD_EAPOL_RELAY]     = { wsbr_eapol_relay_rx,       EPOLLIN,             4 },
+    [POLLFD_PAE_AUTH]        = { wsbr_pae_auth_rx,          EPOLLIN,             4 },
+    [POLLFD_RADIUS]          = { wsbr_radius_rx,            EPOLLIN,             4 },
+    [POLLFD_NETLINK]         = { wsbr_netlink_rx,           EPOLLIN,             1 },
+    [POLLFD_SIGNAL]          = { wsbr_signal_rx,            EPOLLIN,             1 },
+};
+
+// Report the changes of ctxt->fds (ie. TUN throttling) to epoll.
+static void wsbr_epoll_update(struct wsbr_ctxt *ctxt)
+{
+    struct epoll_event event = { };
+    int ret;
+
+    for (int i = 0; i < POLLFD_COUNT; i++) {
+        if (ctxt->epoll_fds[i].fd == ctxt->fds[i].fd &&
+            ctxt->epoll_fds[i].events == ctxt->fds[i].events)
+            continue;
+        // The fd may already have been closed, and thus removed from epoll
+        if (ctxt->epoll_fds[i].fd >= 0 && ctxt->epoll_fds[i].fd != ctxt->fds[i].fd)
+            epoll_ctl(ctxt->epoll_fd, EPOLL_CTL_DEL, ctxt->epoll_fds[i].fd, NULL);
+        if (ctxt->fds[i].fd >= 0) {
+            event.events = ctxt->fds[i].events & POLLIN ? EPOLLIN : 0;
+            event.data.u32 = i;
+            if (ctxt->epoll_fds[i].fd == ctxt->fds[i].fd)
+                ret = epoll_ctl(ctxt->epoll_fd, EPOLL_CTL_MOD, ctxt->fds[i].fd, &event);
+            else
+                ret = epoll_ctl(ctxt->epoll_fd, EPOLL_CTL_ADD, ctxt->fds[i].fd, &event);
+            // Regular files (ie. replayed captures) cannot be watched
+            FATAL_ON(ret < 0 && errno != EPERM, 2, "epoll_ctl: %m");
+            if (ctxt->epoll_fds[i].fd != ctxt->fds[i].fd &&
+                wsbr_sources[i].budget > 1 && i != POLLFD_RCP) {
+                ret = fcntl(ctxt->fds[i].fd, F_GETFL);
+                FATAL_ON(ret < 0, 2, "fcntl: %m");
+                ret = fcntl(ctxt->fds[i].fd, F_SETFL, ret | O_NONBLOCK);
+                FATAL_ON(ret < 0, 2, "fcntl: %m");
+            }
+        }
+        ctxt->epoll_fds[i] = ctxt->fds[i];
+    }
+}
+
+static void wsbr_epoll(struct wsbr_ctxt *ctxt)
+{
+    struct epoll_event events[POLLFD_COUNT];
+    bool ready[POLLFD_COUNT] = { };
+    bool pending;
+    int ret;
+
+    wsbr_tun_throttle(ctxt, true);
+    wsbr_epoll_update(ctxt);
+    ret = epoll_wait(ctxt->epoll_fd, events, POLLFD_COUNT,
+                     ctxt->rcp.bus.uart.data_ready ? 0 : -1);
+    if (ret < 0 && errno == EINTR)
+        return;
+    FATAL_ON(ret < 0, 2, "epoll_wait: %m");
+    for (int i = 0; i < ret; i++)
+        if (events[i].events & wsbr_sources[events[i].data.u32].events)
+            ready[events[i].data.u32] = true;
+    if (ctxt->rcp.bus.uart.data_ready)
+        ready[POLLFD_RCP] = true;
+
+    for (int round = 0; ; round++) {
+        pending = false;
+        for (int i = 0; i < POLLFD_COUNT; i++) {
+            if (!ready[i])
+                continue;
+            ready[i] = wsbr_sources[i].rx(ctxt) && round + 1 < wsbr_sources[i].budget;
+            // A handler may close or reopen a fd
+            wsbr_epoll_update(ctxt);
+            if (ctxt->epoll_fds[i].fd < 0)
+                ready[i] = false;
+            pending |= ready[i];
+        }
+        if (!pending)
+            break;
+    }
+    tun_nl_flush();
+    dbus_flush(ctxt);
+    storage_flush();
+}
+
+static void wsbr_epoll_init(struct wsbr_ctxt *ctxt)
+{
+    ctxt->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    FATAL_ON(ctxt->epoll_fd < 0, 2, "epoll_create1: %m");
+    for (int i = 0; i < POLLFD_COUNT; i++)
+        ctxt->epoll_fds[i].fd = -1;
+    wsbr_epoll_update(ctxt);
 }
 
 int wsbr_main(int argc, char *argv[])
@@ -626,11 +936,8 @@ int wsbr_main(int argc, char *argv[])
     struct wsbr_ctxt *ctxt = &g_ctxt;
 
     INFO("Silicon Labs Wi-SUN border router %s", version_daemon_str);
+    wsbr_signal_init(ctxt);
     sigact.sa_flags = SA_RESETHAND;
-    sigact.sa_handler = kill_handler;
-    sigaction(SIGINT, &sigact, NULL);
-    sigaction(SIGHUP, &sigact, NULL);
-    sigaction(SIGTERM, &sigact, NULL);
     sigact.sa_handler = sig_error_handler;
     sigaction(SIGILL, &sigact, NULL);
     sigaction(SIGSEGV, &sigact, NULL);
@@ -644,7 +951,7 @@ int wsbr_main(int argc, char *argv[])
         g_enable_color_traces = ctxt->config.color_output;
     wsbr_check_mbedtls_features();
     event_scheduler_init(&ctxt->scheduler);
-    g_storage_prefix = ctxt->config.storage_prefix;
+    storage_init(ctxt->config.storage_prefix, ctxt->config.storage_sync_interval, files);
     if (ctxt->config.storage_delete) {
         INFO("deleting storage");
         storage_delete(files);
@@ -671,11 +978,21 @@ int wsbr_main(int argc, char *argv[])
                               ctxt->net_if.ws_info.pan_information.lfn_version, ctxt->net_if.ws_info.network_name);
     ws_bootstrap_6lbr_init(&ctxt->net_if);
     wsbr_fds_init(ctxt);
+    if (ctxt->config.use_epoll)
+        wsbr_epoll_init(ctxt);
 
     INFO("Wi-SUN Border Router is ready");
 
-    while (true)
-        wsbr_poll(ctxt);
+    while (!wsbr_exit_requested) {
+        if (ctxt->config.use_epoll)
+            wsbr_epoll(ctxt);
+        else
+            wsbr_poll(ctxt);
+    }
 
-    return 0;
+    // Refreshed registrations are only saved periodically
+    ipv6_neighbour_storage_flush(&ctxt->net_if.ipv6_neighbour_cache);
+    if (ctxt->config.uart_dev[0])
+        uart_tx_flush(&ctxt->rcp.bus);
+    exit(0);
 }
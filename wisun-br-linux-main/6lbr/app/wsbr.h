@@ -33,6 +33,14 @@ typedef struct sd_bus sd_bus;
 
 struct iobuf_read;
 
+struct wsbr_tun_throttle {
+    bool throttled;
+    int admit;                  // TUN packets which can still be read during this wakeup
+    uint64_t throttle_start_ms;
+    uint64_t throttled_ms;      // Total time spent throttled
+    unsigned int throttle_count;
+};
+
 enum {
     POLLFD_TUN,
     POLLFD_RCP,
@@ -45,12 +53,16 @@ enum {
     POLLFD_EAPOL_RELAY,
     POLLFD_PAE_AUTH,
     POLLFD_RADIUS,
-    POLLFD_PCAP,
+    POLLFD_NETLINK,
+    POLLFD_SIGNAL,
     POLLFD_COUNT,
 };
 
 struct wsbr_ctxt {
     struct pollfd fds[POLLFD_COUNT];
+    // State of the fds registered in epoll_fd, only used with use_epoll
+    struct pollfd epoll_fds[POLLFD_COUNT];
+    int epoll_fd;
     struct events_scheduler scheduler;
     struct wsbrd_conf config;
     struct dhcp_server dhcp_server;
@@ -58,18 +70,16 @@ struct wsbr_ctxt {
     sd_bus *dbus;
 
     int timerfd;
+    int signal_fd;
 
     int  tun_fd;
+    struct wsbr_tun_throttle tun_throttle;
     int  sock_mcast;
 
     struct rcp rcp;
 
     int spinel_tid;
     int spinel_iid;
-
-    int pcapng_fd;
-    mode_t pcapng_type;
-    uint64_t pcapng_t0_us;
 };
 
 // This global variable is necessary for various API of nanostack. Beside this
@@ -64,7 +64,8 @@ void wsbr_data_req_ext(struct net_if *cur,
         .hif.handle = data->msduHandle,
         .hif.status = HIF_STATUS_TIMEDOUT,
     };
-    struct iobuf_write frame = { };
+    // Kept across calls so the frame is built without any allocation
+    static struct iobuf_write frame;
 
     BUG_ON(data->TxAckReq && data->fhss_type == HIF_FHSS_TYPE_ASYNC);
     BUG_ON(data->DstAddrMode != MAC_ADDR_MODE_NONE &&
@@ -87,13 +88,13 @@ void wsbr_data_req_ext(struct net_if *cur,
         return;
     }
 
+    frame.len = 0;
     wsbr_data_req_rebuild(&frame, cur->rcp, data, ie_ext, cur->ws_info.pan_information.pan_id);
     rcp_req_data_tx(cur->rcp, frame.data, frame.len,
                     data->msduHandle,  data->fhss_type, neighbor_ws ? &neighbor_ws->fhss_data_unsecured : NULL,
                     neighbor_ws ? neighbor_ws->frame_counter_min : NULL,
                     data->rate_list[0].phy_mode_id ? data->rate_list : NULL,
                     data->ms_mode == WS_MODE_SWITCH_MAC ? HIF_MODE_SWITCH_TYPE_MAC : HIF_MODE_SWITCH_TYPE_PHY);
-    iobuf_free(&frame);
 }
 
 void wsbr_tx_cnf(struct rcp *rcp, const struct hif_tx_cnf *cnf)
@@ -13,6 +13,11 @@
  */
 #define _DEFAULT_SOURCE
 #include <sys/stat.h>
+#include <semaphore.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -30,52 +35,193 @@
 
 #include "rcp_api_legacy.h"
 #include "frame_helpers.h"
+#include "wsbr_pcapng.h"
 #include "wsbr.h"
 
-void wsbr_pcapng_closed(struct wsbr_ctxt *ctxt)
-{
-    int ret;
+/*
+ * Frames are captured from the MAC callbacks, which must not wait for the
+ * capture output (typically a FIFO read by Wireshark). They are copied into a
+ * single producer single consumer ring, and a dedicated thread encodes and
+ * writes them. The semaphores count the filled and free slots, so no lock is
+ * taken in the nominal case. When the ring is full, frames are either
+ * dropped or the main loop waits depending on the "pcap_overflow" option.
+ *
+ * Only the writer thread touches the output file descriptor. It stays
+ * non-blocking so a stalled FIFO reader never prevents the thread from
+ * noticing a stop request. The writer thread never exits the process: on a
+ * write error it stops writing (but keeps consuming the ring) and the main
+ * thread reports the error the next time it queues a frame.
+ */
+#define WSBR_PCAPNG_POLL_TIMEOUT_MS 100
 
+struct wsbr_pcapng_frame {
+    uint64_t timestamp_us;
+    uint16_t len;
+    uint8_t data[MAC_IEEE_802_15_4G_MAX_PHY_PACKET_SIZE];
+};
+
+static struct {
+    const char *path;
+    int fd;
+    mode_t type;
+    uint64_t t0_us;
+
+    struct wsbr_pcapng_frame *ring;
+    int ring_size;
+    int head; // Only accessed by the main thread
+    int tail; // Only accessed by the writer thread
+    sem_t filled;
+    sem_t free;
+    bool block;
+    atomic_bool stop;
+    atomic_int error; // errno of the write error which stopped the capture
+    pthread_t thread;
+
+    // Only accessed by the main thread
+    unsigned int dropped;
+    unsigned int dropped_total;
+    bool failed;
+} g_pcapng = {
+    .fd = -1,
+};
+
+static void wsbr_pcapng_closed(void)
+{
     WARN("stopped pcapng capture");
-    ret = close(ctxt->pcapng_fd);
-    FATAL_ON(ret < 0, 2, "close pcapng: %m");
-    ctxt->pcapng_fd = -1;
-    ctxt->fds[POLLFD_PCAP].fd = -1;
+    if (close(g_pcapng.fd) < 0)
+        WARN("close pcapng: %m");
+    g_pcapng.fd = -1;
 }
 
-static void wsbr_pcapng_write_start(struct wsbr_ctxt *ctxt);
+static int wsbr_pcapng_write_start(void);
 
-static void wsbr_pcapng_write(struct wsbr_ctxt *ctxt, const struct iobuf_write *buf)
+// Return 0 or a negative errno value
+static int wsbr_pcapng_write(const struct iobuf_write *buf)
 {
-    int ret;
+    struct pollfd pfd = { .events = POLLOUT };
+    size_t offset = 0;
+    ssize_t ret;
 
     // recover if other process stopped reading from FIFO
-    if (ctxt->pcapng_fd < 0) {
-        ctxt->pcapng_fd = open(ctxt->config.pcap_file, O_WRONLY | O_NONBLOCK);
-        if (ctxt->pcapng_fd < 0)
-            return;
+    if (g_pcapng.fd < 0) {
+        g_pcapng.fd = open(g_pcapng.path, O_WRONLY | O_NONBLOCK);
+        if (g_pcapng.fd < 0)
+            return 0;
         WARN("restarted pcapng capture");
-        ctxt->fds[POLLFD_PCAP].fd = ctxt->pcapng_fd;
-        wsbr_pcapng_write_start(ctxt);
+        ret = wsbr_pcapng_write_start();
+        if (ret < 0 || g_pcapng.fd < 0)
+            return ret;
     }
 
-    ret = write(ctxt->pcapng_fd, buf->data, buf->len);
-    if (ret >= 0)
-        return;
-    if (ctxt->pcapng_type == S_IFIFO && errno == EAGAIN)
-        WARN("pcapng fifo full");
-    else
-        FATAL(2, "write pcapng: %m");
+    while (offset < buf->len) {
+        ret = write(g_pcapng.fd, buf->data + offset, buf->len - offset);
+        if (ret >= 0) {
+            offset += ret;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (g_pcapng.type == S_IFIFO && errno == EPIPE) {
+            wsbr_pcapng_closed();
+            return 0;
+        }
+        if (errno != EAGAIN)
+            return -errno;
+        // Do not hang the exit on a FIFO which is not read anymore
+        if (atomic_load(&g_pcapng.stop))
+            return 0;
+        pfd.fd = g_pcapng.fd;
+        if (poll(&pfd, 1, WSBR_PCAPNG_POLL_TIMEOUT_MS) < 0 && errno != EINTR)
+            return -errno;
+    }
+    return 0;
 }
 
-static void wsbr_pcapng_write_start(struct wsbr_ctxt *ctxt)
+static int wsbr_pcapng_write_start(void)
 {
     struct iobuf_write buf = { };
+    int ret;
 
     pcapng_write_shb(&buf);
     pcapng_write_idb(&buf, LINKTYPE_IEEE802_15_4_NOFCS);
-    wsbr_pcapng_write(ctxt, &buf);
+    ret = wsbr_pcapng_write(&buf);
     iobuf_free(&buf);
+    return ret;
+}
+
+static int wsbr_pcapng_encode_frame(const struct wsbr_pcapng_frame *frame)
+{
+    struct iobuf_write iobuf_pcapng = { };
+    struct iobuf_write iobuf_frame = { };
+    struct iobuf_read ie_payload;
+    struct iobuf_read ie_header;
+    struct ieee802154_hdr hdr;
+    int ret;
+
+    ret = ieee802154_frame_parse(frame->data, frame->len, &hdr, &ie_header, &ie_payload);
+    if (ret < 0)
+        return 0;
+    hdr.key_index = 0; // Strip the Auxiliary Security Header
+
+    ieee802154_frame_write_hdr(&iobuf_frame, &hdr);
+    iobuf_push_data(&iobuf_frame, ie_header.data, ie_header.data_size);
+    if (ie_payload.data_size) {
+        ieee802154_ie_push_header(&iobuf_frame, IEEE802154_IE_ID_HT1);
+        iobuf_push_data(&iobuf_frame, ie_payload.data, ie_payload.data_size);
+    }
+
+    pcapng_write_epb(&iobuf_pcapng, frame->timestamp_us + g_pcapng.t0_us,
+                     iobuf_frame.data, iobuf_frame.len);
+    ret = wsbr_pcapng_write(&iobuf_pcapng);
+
+    iobuf_free(&iobuf_pcapng);
+    iobuf_free(&iobuf_frame);
+    return ret;
+}
+
+static void *wsbr_pcapng_thread(void *arg)
+{
+    int ret;
+
+    for (;;) {
+        if (sem_wait(&g_pcapng.filled) < 0) {
+            if (errno == EINTR)
+                continue;
+            atomic_store(&g_pcapng.error, errno);
+            return NULL;
+        }
+        if (atomic_load(&g_pcapng.stop)) {
+            // Do not hang the exit on a FIFO which is not read anymore
+            if (g_pcapng.type == S_IFIFO)
+                return NULL;
+            // The stop request is queued after the last frame
+            if (g_pcapng.tail == g_pcapng.head)
+                return NULL;
+        }
+        // After an error, frames are still consumed so the main thread never
+        // waits for a free slot forever
+        if (!atomic_load(&g_pcapng.error)) {
+            ret = wsbr_pcapng_encode_frame(&g_pcapng.ring[g_pcapng.tail]);
+            if (ret < 0) {
+                atomic_store(&g_pcapng.error, -ret);
+                close(g_pcapng.fd);
+                g_pcapng.fd = -1;
+            }
+        }
+        g_pcapng.tail = (g_pcapng.tail + 1) % g_pcapng.ring_size;
+        sem_post(&g_pcapng.free);
+    }
+}
+
+static void wsbr_pcapng_exit(void)
+{
+    if (pthread_equal(pthread_self(), g_pcapng.thread))
+        return;
+    atomic_store(&g_pcapng.stop, true);
+    sem_post(&g_pcapng.filled);
+    pthread_join(g_pcapng.thread, NULL);
+    if (g_pcapng.dropped_total)
+        WARN("pcapng: %u frames dropped", g_pcapng.dropped_total);
 }
 
 void wsbr_pcapng_init(struct wsbr_ctxt *ctxt)
@@ -83,66 +229,91 @@ void wsbr_pcapng_init(struct wsbr_ctxt *ctxt)
     struct stat statbuf;
     int ret;
 
-    ret = stat(ctxt->config.pcap_file, &statbuf);
+    g_pcapng.path = ctxt->config.pcap_file;
+    ret = stat(g_pcapng.path, &statbuf);
     if (ret) {
         if (errno == ENOENT)
-            ctxt->pcapng_type = S_IFREG;
+            g_pcapng.type = S_IFREG;
         else
-            FATAL(2, "stat %s: %m", ctxt->config.pcap_file);
+            FATAL(2, "stat %s: %m", g_pcapng.path);
     } else {
-        ctxt->pcapng_type = statbuf.st_mode & S_IFMT;
+        g_pcapng.type = statbuf.st_mode & S_IFMT;
     }
-    if (ctxt->pcapng_type == S_IFIFO) {
-        ctxt->pcapng_fd = open(ctxt->config.pcap_file, O_WRONLY | O_NONBLOCK);
-        if (ctxt->pcapng_fd < 0) {
+    if (g_pcapng.type == S_IFIFO) {
+        g_pcapng.fd = open(g_pcapng.path, O_WRONLY | O_NONBLOCK);
+        if (g_pcapng.fd < 0) {
             if (errno == ENXIO)
-                WARN("open %s: FIFO not yet opened for reading", ctxt->config.pcap_file);
+                WARN("open %s: FIFO not yet opened for reading", g_pcapng.path);
             else
-                FATAL(2, "open %s: %m", ctxt->config.pcap_file);
+                FATAL(2, "open %s: %m", g_pcapng.path);
         }
     } else {
-        ctxt->pcapng_fd = open(ctxt->config.pcap_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-        FATAL_ON(ctxt->pcapng_fd < 0, 2, "open %s: %m", ctxt->config.pcap_file);
+        g_pcapng.fd = open(g_pcapng.path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        FATAL_ON(g_pcapng.fd < 0, 2, "open %s: %m", g_pcapng.path);
     }
+    ret = wsbr_pcapng_write_start();
+    FATAL_ON(ret < 0, 2, "write pcapng: %s", strerror(-ret));
 
-    ctxt->fds[POLLFD_PCAP].fd = ctxt->pcapng_fd;
-    wsbr_pcapng_write_start(ctxt);
+    g_pcapng.ring_size = ctxt->config.pcap_queue_size;
+    g_pcapng.ring = xalloc(g_pcapng.ring_size * sizeof(struct wsbr_pcapng_frame));
+    g_pcapng.block = ctxt->config.pcap_overflow == PCAP_OVERFLOW_BLOCK;
+    ret = sem_init(&g_pcapng.filled, 0, 0);
+    FATAL_ON(ret < 0, 2, "sem_init: %m");
+    ret = sem_init(&g_pcapng.free, 0, g_pcapng.ring_size);
+    FATAL_ON(ret < 0, 2, "sem_init: %m");
+    ret = pthread_create(&g_pcapng.thread, NULL, wsbr_pcapng_thread, NULL);
+    FATAL_ON(ret, 2, "pthread_create: %s", strerror(ret));
+    atexit(wsbr_pcapng_exit);
 }
 
 void wsbr_pcapng_write_frame(struct wsbr_ctxt *ctxt, uint64_t timestamp_us,
                              const void *frame, size_t frame_len)
 {
-    struct iobuf_write iobuf_pcapng = { };
-    struct iobuf_write iobuf_frame = { };
-    struct iobuf_read ie_payload;
-    struct iobuf_read ie_header;
-    struct ieee802154_hdr hdr;
+    struct wsbr_pcapng_frame *slot;
     struct timespec tp;
     int ret;
 
-    ret = ieee802154_frame_parse(frame, frame_len, &hdr, &ie_header, &ie_payload);
-    if (ret < 0)
+    if (g_pcapng.failed)
+        return;
+    ret = atomic_load(&g_pcapng.error);
+    if (ret) {
+        ERROR("pcapng capture stopped: %s", strerror(ret));
+        g_pcapng.failed = true;
+        return;
+    }
+    if (frame_len > sizeof(slot->data)) {
+        TRACE(TR_DROP, "drop %-9s: frame too long", "pcapng");
         return;
-    hdr.key_index = 0; // Strip the Auxiliary Security Header
-
-    ieee802154_frame_write_hdr(&iobuf_frame, &hdr);
-    iobuf_push_data(&iobuf_frame, ie_header.data, ie_header.data_size);
-    if (ie_payload.data_size) {
-        ieee802154_ie_push_header(&iobuf_frame, IEEE802154_IE_ID_HT1);
-        iobuf_push_data(&iobuf_frame, ie_payload.data, ie_payload.data_size);
+    }
+    if (g_pcapng.block) {
+        while ((ret = sem_wait(&g_pcapng.free)) < 0)
+            FATAL_ON(errno != EINTR, 2, "sem_wait: %m");
+    } else {
+        ret = sem_trywait(&g_pcapng.free);
+        FATAL_ON(ret < 0 && errno != EAGAIN, 2, "sem_trywait: %m");
+    }
+    if (ret < 0) {
+        g_pcapng.dropped++;
+        g_pcapng.dropped_total++;
+        return;
+    }
+    if (g_pcapng.dropped) {
+        WARN("pcapng queue full, %u frames dropped", g_pcapng.dropped);
+        g_pcapng.dropped = 0;
     }
 
-    if (!ctxt->pcapng_t0_us) {
+    if (!g_pcapng.t0_us) {
         // NOTE: Since time is measured only once, details like clock drift and
-        // leap seconds are ignored.
+        // leap seconds are ignored. Measure it before the frame waits in the
+        // ring. The writer thread reads it after sem_post().
         clock_gettime(CLOCK_REALTIME, &tp);
-        ctxt->pcapng_t0_us = (uint64_t)tp.tv_sec * 1000000 + tp.tv_nsec / 1000 - timestamp_us;
+        g_pcapng.t0_us = (uint64_t)tp.tv_sec * 1000000 + tp.tv_nsec / 1000 - timestamp_us;
     }
 
-    pcapng_write_epb(&iobuf_pcapng, timestamp_us + ctxt->pcapng_t0_us,
-                     iobuf_frame.data, iobuf_frame.len);
-    wsbr_pcapng_write(ctxt, &iobuf_pcapng);
-
-    iobuf_free(&iobuf_pcapng);
-    iobuf_free(&iobuf_frame);
+    slot = &g_pcapng.ring[g_pcapng.head];
+    slot->timestamp_us = timestamp_us;
+    slot->len = frame_len;
+    memcpy(slot->data, frame, frame_len);
+    g_pcapng.head = (g_pcapng.head + 1) % g_pcapng.ring_size;
+    sem_post(&g_pcapng.filled);
 }
@@ -1027,7 +1027,6 @@ static void ipv6_refresh_neighbor_lifetime(buffer_t *buf, const uint8_t *eui64)
 {
     ipv6_neighbour_t *ipv6_neighbour = ipv6_neighbour_lookup(&buf->interface->ipv6_neighbour_cache, buf->src_sa.address);
     struct ws_neigh *ws_neigh;
-    struct ipv6_nd_opt_earo aro;
 
     if (!ipv6_neighbour || ipv6_neighbour->type != IP_NEIGHBOUR_REGISTERED)
         return;
@@ -1039,10 +1038,7 @@ static void ipv6_refresh_neighbor_lifetime(buffer_t *buf, const uint8_t *eui64)
     if (!ws_neigh)
         return;
 
-    aro.status = ARO_SUCCESS;
-    aro.lifetime = ws_neigh->lifetime_s / 60;
-
-    nd_update_registration(buf->interface, ipv6_neighbour, &aro);
+    nd_refresh_registration(buf->interface, ipv6_neighbour, ws_neigh->lifetime_s);
     ws_neigh_refresh(ws_neigh, ws_neigh->lifetime_s);
 }
 
@@ -17,7 +17,6 @@
 #include <arpa/inet.h>
 #include <fnmatch.h>
 #include <stdlib.h>
-#include <glob.h>
 
 #include "common/key_value_storage.h"
 #include "common/time_extra.h"
@@ -100,7 +99,7 @@ static void ipv6_neigh_storage_load_neigh(struct ipv6_neighbour_cache *cache, co
         WARN("%s %s failure", __func__, filename);
         return;
     }
-    nvm = storage_open(filename, "r");
+    nvm = storage_open_prefix(filename, "r");
     if (!nvm) {
         WARN("%s %s failure", __func__, filename);
         return;
@@ -163,6 +162,7 @@ static void ipv6_neigh_storage_load_neigh(struct ipv6_neighbour_cache *cache, co
         // the neighbor state is set to stale
         ipv6_neighbour_entry_update_unsolicited(cache, ipv6_neigh, ll_addr.addr_type, ll_addr.address);
         ipv6_neigh->type = IP_NEIGHBOUR_REGISTERED;
+        ipv6_neighbour_expiration_update(cache, ipv6_neigh);
     }
 
     storage_close(nvm);
@@ -171,17 +171,10 @@ static void ipv6_neigh_storage_load_neigh(struct ipv6_neighbour_cache *cache, co
 
 void ipv6_neigh_storage_load(struct ipv6_neighbour_cache *cache)
 {
-    char pattern[PATH_MAX];
-    glob_t globbuf;
-    int ret;
-
-    sprintf(pattern, "%s%s", g_storage_prefix, "neighbor-*");
-    ret = glob(pattern, 0, NULL, &globbuf);
-    if (ret && ret != GLOB_NOMATCH)
-        WARN("%s: glob %s returned %u", __func__, pattern, ret);
-    if (ret)
-        return;
+    char **filenames;
 
-    for (int i = 0; globbuf.gl_pathv[i]; i++)
-        ipv6_neigh_storage_load_neigh(cache, globbuf.gl_pathv[i]);
+    filenames = storage_glob("neighbor-*");
+    for (int i = 0; filenames[i]; i++)
+        ipv6_neigh_storage_load_neigh(cache, filenames[i]);
+    storage_glob_free(filenames);
 }
@@ -40,6 +40,8 @@
 #include <netinet/in.h>
 #include "common/rand.h"
 #include "common/bits.h"
+#include "common/fnv_hash.h"
+#include "common/mathutils.h"
 #include "common/memutils.h"
 #include "common/log_legacy.h"
 #include "common/string_extra.h"
@@ -63,7 +65,8 @@
 #define NCACHE_MAX_LONG_TERM    8   /* Target for basic GC - expire old entries if more than this */
 #define NCACHE_MAX_SHORT_TERM   32  /* Expire stale entries if more than this */
 #define NCACHE_MAX_ABSOLUTE     64  /* Never have more than this */
-#define NCACHE_GC_AGE           600 /* 10 minutes (1s units - decremented every slow timer call) */
+#define NCACHE_GC_AGE           600 /* 10 minutes */
+#define NCACHE_STORAGE_PERIOD   60  /* seconds - coalesce storage updates of refreshed registrations */
 
 /* Destination Cache garbage collection parameters (system-wide) */
 #define DCACHE_MAX_LONG_TERM    16
@@ -79,6 +82,23 @@
 static NS_LIST_DEFINE(ipv6_destination_cache, ipv6_destination_t, link);
 static NS_LIST_DEFINE(ipv6_routing_table, ipv6_route_t, link);
 
+/*
+ * Index over the routing table, used for longest prefix match. Routes are
+ * hashed on (prefix, prefix_len) into chained buckets, and the number of
+ * routes of each prefix length is tracked, so a lookup only probes one
+ * bucket per prefix length in use (typically /128 host routes, the /64
+ * on-link prefix and the ::/0 default route). Chains keep the same relative
+ * order as ipv6_routing_table, so ties are resolved as with a linear scan.
+ */
+#define IPV6_ROUTE_INDEX_SIZE_MIN 64
+
+static struct {
+    ipv6_route_t **buckets;
+    size_t size;                    // always a power of 2
+    size_t count;
+    uint32_t prefix_len_count[129];
+} ipv6_route_index;
+
 static void ipv6_destination_cache_forget_neighbour(const ipv6_neighbour_t *neighbour);
 static bool ipv6_destination_release(ipv6_destination_t *dest);
 static uint16_t total_metric(const ipv6_route_t *route);
@@ -101,13 +121,223 @@ static uint32_t next_probe_time(ipv6_neighbour_cache_t *cache, uint_fast8_t retr
     return rand_randomise_base(t, 0x4000, 0xBFFF);
 }
 
+#define NCACHE_INDEX_SIZE_MIN 64
+
+static ipv6_neighbour_t **ipv6_neighbour_addr_bucket(ipv6_neighbour_cache_t *cache, const uint8_t *address)
+{
+    return &cache->addr_index[fnv_hash_reverse_32_init(address, 16) & (cache->index_size - 1)];
+}
+
+static ipv6_neighbour_t **ipv6_neighbour_eui64_bucket(ipv6_neighbour_cache_t *cache, const uint8_t *eui64)
+{
+    return &cache->eui64_index[fnv_hash_reverse_32_init(eui64, 8) & (cache->index_size - 1)];
+}
+
+/* The EUI-64 is only stored if the interface receives registrations */
+static void ipv6_neighbour_index_link(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
+{
+    ipv6_neighbour_t **bucket;
+
+    bucket = ipv6_neighbour_addr_bucket(cache, entry->ip_address);
+    entry->addr_next = *bucket;
+    *bucket = entry;
+    if (cache->recv_addr_reg) {
+        bucket = ipv6_neighbour_eui64_bucket(cache, ipv6_neighbour_eui64(cache, entry));
+        entry->eui64_next = *bucket;
+        *bucket = entry;
+    }
+}
+
+static void ipv6_neighbour_index_unlink(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
+{
+    ipv6_neighbour_t **ptr;
+
+    for (ptr = ipv6_neighbour_addr_bucket(cache, entry->ip_address); *ptr != entry; ptr = &(*ptr)->addr_next)
+        ;
+    *ptr = entry->addr_next;
+    if (cache->recv_addr_reg) {
+        for (ptr = ipv6_neighbour_eui64_bucket(cache, ipv6_neighbour_eui64(cache, entry)); *ptr != entry; ptr = &(*ptr)->eui64_next)
+            ;
+        *ptr = entry->eui64_next;
+    }
+}
+
+/* Must be called after the entry is added at the start of the list */
+static void ipv6_neighbour_index_add(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
+{
+    cache->count++;
+    if (cache->count <= cache->index_size) {
+        ipv6_neighbour_index_link(cache, entry);
+        return;
+    }
+
+    free(cache->addr_index);
+    free(cache->eui64_index);
+    cache->index_size = MAX(cache->index_size * 2, NCACHE_INDEX_SIZE_MIN);
+    cache->addr_index = zalloc(cache->index_size * sizeof(ipv6_neighbour_t *));
+    cache->eui64_index = zalloc(cache->index_size * sizeof(ipv6_neighbour_t *));
+    /* Oldest first, so chains end up in list order */
+    ns_list_foreach_reverse(ipv6_neighbour_t, cur, &cache->list)
+        ipv6_neighbour_index_link(cache, cur);
+}
+
+static time_t ipv6_neighbour_expiration(const ipv6_neighbour_t *entry)
+{
+    /* No lifetime means expired */
+    return entry->lifetime_s ? entry->expiration_s : 0;
+}
+
+static uint64_t ipv6_neighbour_expiration_key(const ipv6_neighbour_t *entry)
+{
+    return ipv6_neighbour_expiration(entry);
+}
+
+static uint64_t ipv6_neighbour_timer_key(const ipv6_neighbour_t *entry)
+{
+    return entry->timer;
+}
+
+static size_t *ipv6_neighbour_heap_pos(const struct ipv6_neighbour_heap *heap, ipv6_neighbour_t *entry)
+{
+    return (size_t *)((uint8_t *)entry + heap->pos_offset);
+}
+
+static bool ipv6_neighbour_heap_less(const struct ipv6_neighbour_heap *heap, size_t i, size_t j)
+{
+    return heap->key(heap->entries[i]) < heap->key(heap->entries[j]);
+}
+
+static void ipv6_neighbour_heap_swap(struct ipv6_neighbour_heap *heap, size_t i, size_t j)
+{
+    ipv6_neighbour_t *tmp = heap->entries[i];
+
+    heap->entries[i] = heap->entries[j];
+    heap->entries[j] = tmp;
+    *ipv6_neighbour_heap_pos(heap, heap->entries[i]) = i + 1;
+    *ipv6_neighbour_heap_pos(heap, heap->entries[j]) = j + 1;
+}
+
+static void ipv6_neighbour_heap_fix(struct ipv6_neighbour_heap *heap, size_t i)
+{
+    size_t child;
+
+    while (i && ipv6_neighbour_heap_less(heap, i, (i - 1) / 2)) {
+        ipv6_neighbour_heap_swap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= heap->len)
+            break;
+        if (child + 1 < heap->len && ipv6_neighbour_heap_less(heap, child + 1, child))
+            child++;
+        if (!ipv6_neighbour_heap_less(heap, child, i))
+            break;
+        ipv6_neighbour_heap_swap(heap, i, child);
+        i = child;
+    }
+}
+
+static void ipv6_neighbour_heap_remove(struct ipv6_neighbour_heap *heap, ipv6_neighbour_t *entry)
+{
+    size_t *pos = ipv6_neighbour_heap_pos(heap, entry);
+    size_t i;
+
+    if (!*pos)
+        return;
+    i = *pos - 1;
+    ipv6_neighbour_heap_swap(heap, i, heap->len - 1);
+    heap->len--;
+    *pos = 0;
+    if (i < heap->len)
+        ipv6_neighbour_heap_fix(heap, i);
+}
+
+// Insert the entry if needed, and restore the heap order after its key changed
+static void ipv6_neighbour_heap_update(struct ipv6_neighbour_heap *heap, ipv6_neighbour_t *entry)
+{
+    size_t *pos = ipv6_neighbour_heap_pos(heap, entry);
+
+    if (!*pos) {
+        if (heap->len == heap->size) {
+            heap->size = MAX(heap->size * 2, NCACHE_INDEX_SIZE_MIN);
+            heap->entries = reallocarray(heap->entries, heap->size, sizeof(ipv6_neighbour_t *));
+            FATAL_ON(!heap->entries, 2, "%s: reallocarray(): %m", __func__);
+        }
+        heap->entries[heap->len++] = entry;
+        *pos = heap->len;
+    }
+    ipv6_neighbour_heap_fix(heap, *pos - 1);
+}
+
+void ipv6_neighbour_expiration_update(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
+{
+    ipv6_neighbour_heap_update(&cache->expiration_heap, entry);
+}
+
+void ipv6_neighbour_timer_set(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry, uint32_t ms)
+{
+    if (ms) {
+        entry->timer = time_now_ms(CLOCK_MONOTONIC) + ms;
+        ipv6_neighbour_heap_update(&cache->timer_heap, entry);
+    } else {
+        entry->timer = 0;
+        ipv6_neighbour_heap_remove(&cache->timer_heap, entry);
+    }
+}
+
+void ipv6_neighbour_storage_mark_dirty(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
+{
+    if (entry->storage_dirty)
+        return;
+    entry->storage_dirty = true;
+    entry->storage_dirty_next = cache->storage_dirty;
+    cache->storage_dirty = entry;
+}
+
+static void ipv6_neighbour_storage_unlink(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry)
+{
+    ipv6_neighbour_t **ptr;
+
+    if (!entry->storage_dirty)
+        return;
+    for (ptr = &cache->storage_dirty; *ptr != entry; ptr = &(*ptr)->storage_dirty_next)
+        ;
+    *ptr = entry->storage_dirty_next;
+    entry->storage_dirty = false;
+}
+
+void ipv6_neighbour_storage_flush(ipv6_neighbour_cache_t *cache)
+{
+    ipv6_neighbour_t *cur = cache->storage_dirty;
+    const uint8_t *eui64;
+
+    // The list is detached first, entries sharing an EUI-64 are skipped once
+    // their node has been saved.
+    cache->storage_dirty = NULL;
+    for (; cur; cur = cur->storage_dirty_next) {
+        if (!cur->storage_dirty)
+            continue;
+        eui64 = ipv6_neighbour_eui64(cache, cur);
+        // The storage file holds all the addresses of a node
+        for (ipv6_neighbour_t *entry = *ipv6_neighbour_eui64_bucket(cache, eui64); entry; entry = entry->eui64_next)
+            if (!memcmp(ipv6_neighbour_eui64(cache, entry), eui64, 8))
+                entry->storage_dirty = false;
+        ipv6_neigh_storage_save(cache, eui64);
+    }
+}
+
 void ipv6_neighbour_cache_init(ipv6_neighbour_cache_t *cache, int8_t interface_id)
 {
     /* Init Double linked Routing Table */
     ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list) {
         ipv6_neighbour_entry_remove(cache, cur);
     }
-    cache->gc_timer = NCACHE_GC_PERIOD;
+    cache->expiration_heap.pos_offset = offsetof(ipv6_neighbour_t, expiration_heap_pos);
+    cache->expiration_heap.key = ipv6_neighbour_expiration_key;
+    cache->timer_heap.pos_offset = offsetof(ipv6_neighbour_t, timer_heap_pos);
+    cache->timer_heap.key = ipv6_neighbour_timer_key;
+    cache->storage_timer = NCACHE_STORAGE_PERIOD;
     cache->retrans_timer = 1000;
     cache->max_ll_len = 2 + 8;
     cache->interface_id = interface_id;
@@ -132,7 +362,10 @@ void ipv6_neighbour_cache_flush(ipv6_neighbour_cache_t *cache)
 
 ipv6_neighbour_t *ipv6_neighbour_lookup(ipv6_neighbour_cache_t *cache, const uint8_t *address)
 {
-    ns_list_foreach(ipv6_neighbour_t, cur, &cache->list)
+    if (!cache->index_size)
+        return NULL;
+
+    for (ipv6_neighbour_t *cur = *ipv6_neighbour_addr_bucket(cache, address); cur; cur = cur->addr_next)
         if (addr_ipv6_equal(cur->ip_address, address))
             return cur;
 
@@ -147,6 +380,11 @@ void ipv6_neighbour_entry_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t
      * it being pushed out while generating ICMP errors, or ICMP errors actually using
      * the entry.
      */
+    ipv6_neighbour_index_unlink(cache, entry);
+    cache->count--;
+    ipv6_neighbour_heap_remove(&cache->expiration_heap, entry);
+    ipv6_neighbour_heap_remove(&cache->timer_heap, entry);
+    ipv6_neighbour_storage_unlink(cache, entry);
     ns_list_remove(&cache->list, entry);
     switch (entry->state) {
         case IP_NEIGHBOUR_NEW:
@@ -172,8 +410,10 @@ ipv6_neighbour_t *ipv6_neighbour_lookup_mc(ipv6_neighbour_cache_t *cache, const
 {
     if (!IN6_IS_ADDR_MULTICAST(address))
         return NULL;
+    if (!cache->index_size)
+        return NULL;
 
-    ns_list_foreach(ipv6_neighbour_t, cur, &cache->list)
+    for (ipv6_neighbour_t *cur = *ipv6_neighbour_addr_bucket(cache, address); cur; cur = cur->addr_next)
         if (addr_ipv6_equal(cur->ip_address, address)) {
             if (memcmp(ipv6_neighbour_eui64(cache, cur), eui64, 8))
                 continue;
@@ -210,6 +450,11 @@ ipv6_neighbour_t *ipv6_neighbour_create(ipv6_neighbour_cache_t *cache, const uin
     if (cache->recv_addr_reg)
         memcpy(ipv6_neighbour_eui64(cache, entry), eui64, 8);
     ns_list_add_to_start(&cache->list, entry);
+    ipv6_neighbour_index_add(cache, entry);
+    /* Garbage-collectible until registered, kept until the next GC period unless used */
+    entry->lifetime_s = NCACHE_GC_PERIOD;
+    entry->expiration_s = time_current(CLOCK_MONOTONIC) + NCACHE_GC_PERIOD;
+    ipv6_neighbour_expiration_update(cache, entry);
     TRACE(TR_NEIGH_IPV6, "IPv6 neighbor add %s / %s",
           tr_eui64(ipv6_neighbour_eui64(cache, entry)), tr_ipv6(entry->ip_address));
 
@@ -222,12 +467,16 @@ ipv6_neighbour_t *ipv6_neighbour_used(ipv6_neighbour_cache_t *cache, ipv6_neighb
     if (entry->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
         entry->lifetime_s = NCACHE_GC_AGE;
         entry->expiration_s = time_current(CLOCK_MONOTONIC) + NCACHE_GC_AGE;
+        ipv6_neighbour_expiration_update(cache, entry);
     }
 
     /* Move it to the front of the list */
     if (entry != ns_list_get_first(&cache->list)) {
         ns_list_remove(&cache->list, entry);
         ns_list_add_to_start(&cache->list, entry);
+        /* Keep index chains in list order */
+        ipv6_neighbour_index_unlink(cache, entry);
+        ipv6_neighbour_index_link(cache, entry);
     }
 
     /* If the entry is stale, prepare delay timer for active NUD probe */
@@ -237,7 +486,7 @@ ipv6_neighbour_t *ipv6_neighbour_used(ipv6_neighbour_cache_t *cache, ipv6_neighb
 
     /* Special case for Registered Unreachable entries - restart the probe timer if stopped */
     else if (entry->state == IP_NEIGHBOUR_UNREACHABLE && entry->timer == 0) {
-        entry->timer = next_probe_time(cache, entry->retrans_count);
+        ipv6_neighbour_timer_set(cache, entry, next_probe_time(cache, entry->retrans_count));
     }
 
     return entry;
@@ -257,7 +506,10 @@ static bool ipv6_neighbour_update_ll(ipv6_neighbour_t *entry, addrtype_e ll_type
 
 bool ipv6_neighbour_has_registered_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list)
+    if (!cache->index_size || !cache->recv_addr_reg)
+        return false;
+
+    for (ipv6_neighbour_t *cur = *ipv6_neighbour_eui64_bucket(cache, eui64); cur; cur = cur->eui64_next)
         if (cur->type != IP_NEIGHBOUR_GARBAGE_COLLECTIBLE &&
             !memcmp(ipv6_neighbour_eui64(cache, cur), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(cur->ip_address))
@@ -267,7 +519,10 @@ bool ipv6_neighbour_has_registered_by_eui64(ipv6_neighbour_cache_t *cache, const
 
 ipv6_neighbour_t *ipv6_neighbour_lookup_gua_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64)
 {
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list)
+    if (!cache->index_size || !cache->recv_addr_reg)
+        return NULL;
+
+    for (ipv6_neighbour_t *cur = *ipv6_neighbour_eui64_bucket(cache, eui64); cur; cur = cur->eui64_next)
         if (cur->type != IP_NEIGHBOUR_GARBAGE_COLLECTIBLE &&
             !memcmp(ipv6_neighbour_eui64(cache, cur), eui64, 8) &&
             !IN6_IS_ADDR_MULTICAST(cur->ip_address) &&
@@ -281,27 +536,27 @@ void ipv6_neighbour_set_state(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *e
     switch (state) {
         case IP_NEIGHBOUR_INCOMPLETE:
             entry->retrans_count = 0;
-            entry->timer = cache->retrans_timer;
+            ipv6_neighbour_timer_set(cache, entry, cache->retrans_timer);
             break;
         case IP_NEIGHBOUR_STALE:
-            entry->timer = 0;
+            ipv6_neighbour_timer_set(cache, entry, 0);
             break;
         case IP_NEIGHBOUR_DELAY:
-            entry->timer = DELAY_FIRST_PROBE_TIME;
+            ipv6_neighbour_timer_set(cache, entry, DELAY_FIRST_PROBE_TIME);
             break;
         case IP_NEIGHBOUR_PROBE:
             entry->retrans_count = 0;
-            entry->timer = next_probe_time(cache, 0);
+            ipv6_neighbour_timer_set(cache, entry, next_probe_time(cache, 0));
             break;
         case IP_NEIGHBOUR_REACHABLE:
-            entry->timer = cache->reachable_time;
+            ipv6_neighbour_timer_set(cache, entry, cache->reachable_time);
             break;
         case IP_NEIGHBOUR_UNREACHABLE:
             /* Progress to this from PROBE - timers continue */
             ipv6_destination_cache_forget_neighbour(entry);
             break;
         default:
-            entry->timer = 0;
+            ipv6_neighbour_timer_set(cache, entry, 0);
             break;
     }
     entry->state = state;
@@ -338,66 +593,41 @@ ipv6_neighbour_t *ipv6_neighbour_update_unsolicited(ipv6_neighbour_cache_t *cach
     return entry;
 }
 
-static void ipv6_neighbour_cache_gc_periodic(ipv6_neighbour_cache_t *cache)
-{
-    ns_list_foreach_reverse_safe(ipv6_neighbour_t, entry, &cache->list) {
-        if (entry->type != IP_NEIGHBOUR_GARBAGE_COLLECTIBLE)
-            continue;
-
-        if (time_current(CLOCK_MONOTONIC) >= entry->expiration_s)
-            ipv6_neighbour_entry_remove(cache, entry);
-    }
-}
-
 void ipv6_neighbour_cache_slow_timer(int seconds)
 {
     ipv6_neighbour_cache_t *cache = &protocol_stack_interface_info_get()->ipv6_neighbour_cache;
 
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list) {
-        if (cur->lifetime_s && cur->expiration_s &&
-            time_current(CLOCK_MONOTONIC) < cur->expiration_s)
-            continue;
-
-        /* Lifetime expired */
-        switch (cur->type) {
-            case IP_NEIGHBOUR_GARBAGE_COLLECTIBLE:
-                /* No immediate action, but 0 lifetime is an input to the GC */
-                break;
+    ipv6_neighbour_t *cur;
 
-            case IP_NEIGHBOUR_TENTATIVE:
-            case IP_NEIGHBOUR_REGISTERED:
-                /* These are deleted as soon as lifetime expires */
-                ipv6_destination_cache_forget_neighbour(cur);
-                ipv6_neighbour_entry_remove(cache, cur);
-                break;
-        }
+    /* Entries are deleted as soon as lifetime expires */
+    while (cache->expiration_heap.len) {
+        cur = cache->expiration_heap.entries[0];
+        if (time_current(CLOCK_MONOTONIC) < ipv6_neighbour_expiration(cur))
+            break;
+        ipv6_destination_cache_forget_neighbour(cur);
+        ipv6_neighbour_entry_remove(cache, cur);
     }
 
-    if (cache->gc_timer > seconds) {
-        cache->gc_timer -= seconds;
-        return;
+    if (cache->storage_timer > seconds) {
+        cache->storage_timer -= seconds;
+    } else {
+        cache->storage_timer = NCACHE_STORAGE_PERIOD;
+        ipv6_neighbour_storage_flush(cache);
     }
-
-    cache->gc_timer = NCACHE_GC_PERIOD;
-    ipv6_neighbour_cache_gc_periodic(cache);
 }
 
 void ipv6_neighbour_cache_fast_timer(int ticks)
 {
     ipv6_neighbour_cache_t *cache = &protocol_stack_interface_info_get()->ipv6_neighbour_cache;
-    uint32_t ms = (uint32_t) ticks * 100;
-
-    ns_list_foreach_safe(ipv6_neighbour_t, cur, &cache->list) {
-        if (cur->timer == 0) {
-            continue;
-        }
+    uint64_t now = time_now_ms(CLOCK_MONOTONIC);
+    ipv6_neighbour_t *cur;
 
-        if (cur->timer > ms) {
-            cur->timer -= ms;
-            continue;
-        }
-
-        cur->timer = 0;
+    /* Restarted timers always land after now, so this loop terminates */
+    while (cache->timer_heap.len) {
+        cur = cache->timer_heap.entries[0];
+        if (cur->timer > now)
+            break;
+        ipv6_neighbour_timer_set(cache, cur, 0);
 
         /* Timer expired */
         switch (cur->state) {
@@ -411,7 +641,7 @@ void ipv6_neighbour_cache_fast_timer(int ticks)
                     ipv6_neighbour_entry_remove(cache, cur);
                 } else {
                     ipv6_interface_resolve_send_ns(cache, cur, false, cur->retrans_count);
-                    cur->timer = cache->retrans_timer;
+                    ipv6_neighbour_timer_set(cache, cur, cache->retrans_timer);
                 }
                 break;
             case IP_NEIGHBOUR_STALE:
@@ -441,14 +671,14 @@ void ipv6_neighbour_cache_fast_timer(int ticks)
                         /* "Final" unicast probe */
                         if (cur->type == IP_NEIGHBOUR_GARBAGE_COLLECTIBLE) {
                             /* Only wait 1 initial retrans time for response to final probe - don't want backoff in this case */
-                            cur->timer = cache->retrans_timer;
+                            ipv6_neighbour_timer_set(cache, cur, cache->retrans_timer);
                         } else {
                             /* We're not going to remove this. Let's stop the timer. We'll restart to probe once more if it's used */
-                            cur->timer = 0;
+                            ipv6_neighbour_timer_set(cache, cur, 0);
                         }
                     } else {
                         /* Backoff for the next probe */
-                        cur->timer = next_probe_time(cache, cur->retrans_count);
+                        ipv6_neighbour_timer_set(cache, cur, next_probe_time(cache, cur->retrans_count));
                     }
                 }
                 break;
@@ -682,6 +912,56 @@ static uint16_t total_metric(const ipv6_route_t *route)
     return metric;
 }
 
+static ipv6_route_t **ipv6_route_index_bucket(const uint8_t *prefix, uint8_t prefix_len)
+{
+    uint8_t addr[16] = { 0 };
+    uint32_t hash;
+
+    bitcpy(addr, prefix, prefix_len);
+    hash = fnv_hash_reverse_32_init(addr, sizeof(addr));
+    hash = fnv_hash_reverse_32_update(&prefix_len, 1, hash);
+    return &ipv6_route_index.buckets[hash & (ipv6_route_index.size - 1)];
+}
+
+static void ipv6_route_index_link(ipv6_route_t *route)
+{
+    ipv6_route_t **bucket = ipv6_route_index_bucket(route->prefix, route->prefix_len);
+
+    route->index_next = *bucket;
+    *bucket = route;
+}
+
+/* Must be called after the route is added at the start of the routing table */
+static void ipv6_route_index_add(ipv6_route_t *route)
+{
+    ipv6_route_index.count++;
+    ipv6_route_index.prefix_len_count[route->prefix_len]++;
+    if (ipv6_route_index.count <= ipv6_route_index.size) {
+        ipv6_route_index_link(route);
+        return;
+    }
+
+    free(ipv6_route_index.buckets);
+    ipv6_route_index.size = MAX(ipv6_route_index.size * 2, IPV6_ROUTE_INDEX_SIZE_MIN);
+    ipv6_route_index.buckets = zalloc(ipv6_route_index.size * sizeof(ipv6_route_t *));
+    /* Oldest first, so chains end up in routing table order */
+    ns_list_foreach_reverse(ipv6_route_t, r, &ipv6_routing_table) {
+        ipv6_route_index_link(r);
+    }
+}
+
+static void ipv6_route_index_remove(ipv6_route_t *route)
+{
+    ipv6_route_t **ptr = ipv6_route_index_bucket(route->prefix, route->prefix_len);
+
+    while (*ptr != route) {
+        ptr = &(*ptr)->index_next;
+    }
+    *ptr = route->index_next;
+    ipv6_route_index.count--;
+    ipv6_route_index.prefix_len_count[route->prefix_len]--;
+}
+
 static void ipv6_route_entry_remove(ipv6_route_t *route)
 {
     tr_info("Deleted route:");
@@ -689,6 +969,7 @@ static void ipv6_route_entry_remove(ipv6_route_t *route)
     if (route->info_autofree) {
         free(route->info.info);
     }
+    ipv6_route_index_remove(route);
     ns_list_remove(&ipv6_routing_table, route);
     free(route);
 }
@@ -722,37 +1003,64 @@ static bool ipv6_route_is_better(const ipv6_route_t *a, const ipv6_route_t *b)
 static ipv6_route_t *ipv6_route_find_best(const uint8_t *addr, int8_t interface_id)
 {
     ipv6_route_t *best = NULL;
-    ns_list_foreach(ipv6_route_t, route, &ipv6_routing_table) {
-        /* We mustn't be skipping this route */
-        if (route->search_skip) {
+
+    if (!ipv6_route_index.size) {
+        return NULL;
+    }
+
+    /* Longer prefixes are always better, so stop at the first length with a match */
+    for (int prefix_len = 128; prefix_len >= 0; prefix_len--) {
+        if (!ipv6_route_index.prefix_len_count[prefix_len]) {
             continue;
         }
+        for (ipv6_route_t *route = *ipv6_route_index_bucket(addr, prefix_len); route; route = route->index_next) {
+            if (route->prefix_len != prefix_len) {
+                continue;
+            }
 
-        /* Interface must match, if caller specified */
-        if (interface_id != -1 && interface_id != route->info.interface_id) {
-            continue;
+            /* We mustn't be skipping this route */
+            if (route->search_skip) {
+                continue;
+            }
+
+            /* Interface must match, if caller specified */
+            if (interface_id != -1 && interface_id != route->info.interface_id) {
+                continue;
+            }
+
+            /* Prefix must match */
+            if (bitcmp(addr, route->prefix, route->prefix_len)) {
+                continue;
+            }
+
+            if (!best || ipv6_route_is_better(route, best)) {
+                best = route;
+            }
         }
+        if (best) {
+            return best;
+        }
+    }
+    return NULL;
+}
 
-        /* Prefix must match */
-        if (bitcmp(addr, route->prefix, route->prefix_len)) {
+/* Only routes matching dest can have been skipped by ipv6_route_choose_next_hop() */
+static void ipv6_route_search_skip_reset(const uint8_t *dest)
+{
+    for (int prefix_len = 128; prefix_len >= 0; prefix_len--) {
+        if (!ipv6_route_index.prefix_len_count[prefix_len]) {
             continue;
         }
-
-        if (!best || ipv6_route_is_better(route, best)) {
-            best = route;
+        for (ipv6_route_t *route = *ipv6_route_index_bucket(dest, prefix_len); route; route = route->index_next) {
+            route->search_skip = false;
         }
     }
-    return best;
 }
 
 ipv6_route_t *ipv6_route_choose_next_hop(const uint8_t *dest, int8_t interface_id)
 {
     ipv6_route_t *best = NULL;
 
-    ns_list_foreach(ipv6_route_t, route, &ipv6_routing_table) {
-        route->search_skip = false;
-    }
-
     /* Search algorithm from RFC 4191, S3.2:
      *
      * When a type C host does next-hop determination and consults its
@@ -807,12 +1115,19 @@ ipv6_route_t *ipv6_route_choose_next_hop(const uint8_t *dest, int8_t interface_i
         break;
     }
 
+    if (ipv6_route_index.size) {
+        ipv6_route_search_skip_reset(dest);
+    }
     return best;
 }
 
 ipv6_route_t *ipv6_route_lookup_with_info(const uint8_t *prefix, uint8_t prefix_len, int8_t interface_id, const uint8_t *next_hop, ipv6_route_src_t source, void *info, int_fast16_t src_id)
 {
-    ns_list_foreach(ipv6_route_t, r, &ipv6_routing_table) {
+    if (!ipv6_route_index.size) {
+        return NULL;
+    }
+
+    for (ipv6_route_t *r = *ipv6_route_index_bucket(prefix, prefix_len); r; r = r->index_next) {
         if (interface_id == r->info.interface_id && prefix_len == r->prefix_len && !bitcmp(prefix, r->prefix, prefix_len)) {
             if (source != ROUTE_ANY) {
                 if (source != r->info.source) {
@@ -940,6 +1255,7 @@ ipv6_route_t *ipv6_route_add_metric(const uint8_t *prefix, uint8_t prefix_len, i
         /* Doesn't matter much where they start off, but put them at the */
         /* beginning so new routes tend to get tried first. */
         ns_list_add_to_start(&ipv6_routing_table, route);
+        ipv6_route_index_add(route);
         changed_info = NEW;
     } else { /* updating a route - only lifetime and metric can be changing */
         route->lifetime = lifetime;
@@ -96,9 +96,15 @@ typedef struct ipv6_neighbour {
     ip_neighbour_cache_state_e      state;
     ip_neighbour_cache_type_e       type;
     addrtype_e                      ll_type;
-    uint32_t                        timer;                      /* 100ms ticks */
+    bool                            storage_dirty;              /* in the cache storage_dirty list */
+    uint64_t                        timer;                      /* CLOCK_MONOTONIC deadline in ms, 0 if stopped */
     uint32_t                        lifetime_s;
     time_t                          expiration_s;
+    size_t                          expiration_heap_pos;        /* 1-based, 0 if not in the heap */
+    size_t                          timer_heap_pos;             /* 1-based, 0 if not in the heap */
+    struct ipv6_neighbour           *addr_next;                 /* next entry in the same address bucket */
+    struct ipv6_neighbour           *eui64_next;                /* next entry in the same EUI-64 bucket */
+    struct ipv6_neighbour           *storage_dirty_next;        /* next entry in the storage_dirty list */
     ns_list_link_t                  link;                       /*!< List link */
     uint8_t                         ll_address[];
 } ipv6_neighbour_t;
@@ -108,6 +114,16 @@ typedef struct ipv6_neighbour {
  */
 #define ipv6_neighbour_eui64(ncache, entry) ((entry)->ll_address + (ncache)->max_ll_len)
 
+// Binary min-heap of neighbour entries. Each heap stores the position of an
+// entry in a dedicated ipv6_neighbour_t field located at pos_offset.
+struct ipv6_neighbour_heap {
+    ipv6_neighbour_t **entries;
+    size_t len;
+    size_t size;
+    size_t pos_offset;
+    uint64_t (*key)(const ipv6_neighbour_t *entry);
+};
+
 typedef struct ipv6_route_info_cache {
     uint16_t                                metric; // interface metric
     uint8_t                                 sources[ROUTE_MAX];
@@ -122,13 +138,25 @@ typedef struct ipv6_neighbour_cache {
     bool                                    omit_na : 1; // except for ARO successes which have a separate flag
     int8_t                                  interface_id;
     uint8_t                                 max_ll_len;
-    uint8_t                                 gc_timer;
+    uint8_t                                 storage_timer;
     uint32_t                                retrans_timer;
     uint32_t                                reachable_time;
     // Interface specific information for route
     ipv6_route_interface_info_t             route_if_info;
     //uint8_t                                   num_entries;
     NS_LIST_HEAD(ipv6_neighbour_t, link)    list;
+    // Hash indexes over list, keyed on the IPv6 address and on the EUI-64.
+    // Chains are kept in the same order as list.
+    ipv6_neighbour_t                        **addr_index;
+    ipv6_neighbour_t                        **eui64_index;
+    size_t                                  index_size;         // always a power of 2
+    size_t                                  count;
+    // Entries ordered by expiration and by NUD timer deadline, so the slow
+    // and fast timers do not need to scan the whole cache.
+    struct ipv6_neighbour_heap              expiration_heap;
+    struct ipv6_neighbour_heap              timer_heap;
+    // Entries saved on the next periodic storage flush
+    ipv6_neighbour_t                        *storage_dirty;
 } ipv6_neighbour_cache_t;
 
 void ipv6_neighbour_cache_init(ipv6_neighbour_cache_t *cache, int8_t interface_id);
@@ -140,6 +168,12 @@ ipv6_neighbour_t *ipv6_neighbour_lookup(ipv6_neighbour_cache_t *cache, const uin
 ipv6_neighbour_t *ipv6_neighbour_lookup_mc(ipv6_neighbour_cache_t *cache, const uint8_t *address, const uint8_t *eui64);
 ipv6_neighbour_t *ipv6_neighbour_create(ipv6_neighbour_cache_t *cache, const uint8_t *address, const uint8_t *eui64);
 void ipv6_neighbour_entry_remove(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry);
+// Must be called after type, lifetime_s or expiration_s of an entry changed
+void ipv6_neighbour_expiration_update(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry);
+// Start the NUD timer of an entry to fire in ms milliseconds, or stop it if ms is 0
+void ipv6_neighbour_timer_set(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry, uint32_t ms);
+void ipv6_neighbour_storage_mark_dirty(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry);
+void ipv6_neighbour_storage_flush(ipv6_neighbour_cache_t *cache);
 bool ipv6_neighbour_has_registered_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64);
 ipv6_neighbour_t *ipv6_neighbour_lookup_gua_by_eui64(ipv6_neighbour_cache_t *cache, const uint8_t *eui64);
 void ipv6_neighbour_entry_update_unsolicited(ipv6_neighbour_cache_t *cache, ipv6_neighbour_t *entry, addrtype_e type, const uint8_t *ll_address/*, bool tentative*/);
@@ -183,6 +217,7 @@ typedef struct ipv6_route {
     ipv6_route_info_t   info;
     uint32_t            lifetime;           // (seconds); 0xFFFFFFFF means permanent
     ns_list_link_t      link;
+    struct ipv6_route   *index_next;        // next route in the same prefix index bucket
     uint8_t             prefix[];           // variable length
 } ipv6_route_t;
 
@@ -72,6 +72,7 @@ void nd_update_registration(struct net_if *cur_interface, ipv6_neighbour_t *neig
                 rpl_target_del(&cur_interface->rpl_root, target);
         }
     }
+    ipv6_neighbour_expiration_update(&cur_interface->ipv6_neighbour_cache, neigh);
     ipv6_neigh_storage_save(&cur_interface->ipv6_neighbour_cache, ipv6_neighbour_eui64(&cur_interface->ipv6_neighbour_cache, neigh));
 }
 
@@ -93,6 +94,36 @@ void nd_restore_aro_routes_by_eui64(struct net_if *net_if, const uint8_t *eui64)
             nd_add_ipv6_neigh_route(net_if, neigh);
 }
 
+/*
+ * Lifetime refresh of an established registration, called on the data path.
+ * Only in-memory expirations are updated, the netlink entries do not expire
+ * and the storage is flushed periodically by the neighbor cache.
+ */
+void nd_refresh_registration(struct net_if *net_if, ipv6_neighbour_t *neigh, uint32_t lifetime_s)
+{
+    ipv6_neighbour_cache_t *cache = &net_if->ipv6_neighbour_cache;
+    struct ipv6_nd_opt_earo aro = {
+        .status   = ARO_SUCCESS,
+        .lifetime = lifetime_s / 60,
+    };
+    ipv6_route_t *route = NULL;
+
+    if (!IN6_IS_ADDR_MULTICAST(neigh->ip_address))
+        route = ipv6_route_lookup_with_info(neigh->ip_address, 128, net_if->id, neigh->ip_address,
+                                            ROUTE_ARO, NULL, 0);
+    if (neigh->type != IP_NEIGHBOUR_REGISTERED || neigh->lifetime_s != aro.lifetime * UINT32_C(60) ||
+        (!route && !IN6_IS_ADDR_MULTICAST(neigh->ip_address))) {
+        nd_update_registration(net_if, neigh, &aro);
+        return;
+    }
+
+    neigh->expiration_s = time_current(CLOCK_MONOTONIC) + neigh->lifetime_s;
+    ipv6_neighbour_expiration_update(cache, neigh);
+    if (route)
+        route->lifetime = neigh->lifetime_s - 2;
+    ipv6_neighbour_storage_mark_dirty(cache, neigh);
+}
+
 /* Process ICMP Neighbor Solicitation (RFC 4861 + RFC 6775 + RFC 8505 + draft-ietf-6lo-multicast-registration-15) EARO. */
 bool nd_ns_earo_handler(struct net_if *cur_interface, const uint8_t *earo_ptr, size_t earo_len,
                         const uint8_t *slla_ptr, const uint8_t src_addr[16], const uint8_t target[16],
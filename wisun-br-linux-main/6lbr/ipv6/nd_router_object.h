@@ -30,6 +30,7 @@ bool nd_ns_earo_handler(struct net_if *cur_interface, const uint8_t *earo_ptr, s
                         const uint8_t *slla_ptr, const uint8_t src_addr[16], const uint8_t target[16],
                         struct ipv6_nd_opt_earo *na_earo);
 void nd_update_registration(struct net_if *cur_interface, ipv6_neighbour_t *neigh, const struct ipv6_nd_opt_earo *aro);
+void nd_refresh_registration(struct net_if *net_if, ipv6_neighbour_t *neigh, uint32_t lifetime_s);
 void nd_remove_aro_routes_by_eui64(struct net_if *cur_interface,const uint8_t *eui64);
 void nd_restore_aro_routes_by_eui64(struct net_if *cur_interface, const uint8_t *eui64);
 
@@ -23,6 +23,8 @@
 #include <limits.h>
 #include <sys/socket.h>
 #include "common/log_legacy.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
 
 #include "net/netaddr_types.h"
 
@@ -30,8 +32,91 @@
 
 #define TRACE_GROUP "buff"
 
+// Number of unused buffers kept in each pool
+#define BUFFER_POOL_DEPTH 64
+
+/*
+ * Released buffers are kept in free lists sorted by size classes, so the data
+ * path does not go through malloc()/free() for each packet. The classes are
+ * large enough for a full IPv6 packet plus some headroom, so the IPv6, SRH and
+ * tunnel headers can be prepended without reallocation. Larger buffers are
+ * allocated from the heap.
+ */
+static struct buffer_pool {
+    const uint16_t size;
+    buffer_list_t free;
+    unsigned int free_count;
+    struct buffer_pool_stats stats;
+} buffer_pools[] = {
+    { .size =  256, .free = NS_LIST_INIT(buffer_pools[0].free), .stats.size =  256 },
+    { .size =  512, .free = NS_LIST_INIT(buffer_pools[1].free), .stats.size =  512 },
+    { .size = 1024, .free = NS_LIST_INIT(buffer_pools[2].free), .stats.size = 1024 },
+    { .size = 2048, .free = NS_LIST_INIT(buffer_pools[3].free), .stats.size = 2048 },
+};
+
 volatile unsigned int buffer_count = 0;
 
+static struct buffer_pool *buffer_pool_get(uint32_t size)
+{
+    for (int i = 0; i < ARRAY_SIZE(buffer_pools); i++)
+        if (size <= buffer_pools[i].size)
+            return &buffer_pools[i];
+    return NULL;
+}
+
+// Return a buffer with at least size bytes of data. The header is not
+// initialized.
+static buffer_t *buffer_alloc(uint32_t size)
+{
+    struct buffer_pool *pool = buffer_pool_get(size);
+    buffer_t *buf;
+
+    if (!pool) {
+        buf = malloc(sizeof(buffer_t) + size);
+        FATAL_ON(!buf, 2);
+        buf->size = size;
+        return buf;
+    }
+    buf = ns_list_get_first(&pool->free);
+    if (buf) {
+        ns_list_remove(&pool->free, buf);
+        pool->free_count--;
+        pool->stats.hits++;
+    } else {
+        buf = malloc(sizeof(buffer_t) + pool->size);
+        FATAL_ON(!buf, 2);
+        pool->stats.misses++;
+    }
+    pool->stats.in_use++;
+    pool->stats.high_water = MAX(pool->stats.high_water, pool->stats.in_use);
+    buf->size = pool->size;
+    return buf;
+}
+
+static void buffer_release(buffer_t *buf)
+{
+    struct buffer_pool *pool = buffer_pool_get(buf->size);
+
+    if (!pool || pool->size != buf->size) {
+        free(buf);
+        return;
+    }
+    pool->stats.in_use--;
+    if (pool->free_count >= BUFFER_POOL_DEPTH) {
+        free(buf);
+    } else {
+        ns_list_add_to_start(&pool->free, buf);
+        pool->free_count++;
+    }
+}
+
+const struct buffer_pool_stats *buffer_pool_stats(int i)
+{
+    if (i < 0 || i >= ARRAY_SIZE(buffer_pools))
+        return NULL;
+    return &buffer_pools[i].stats;
+}
+
 uint8_t *buffer_corrupt_check(buffer_t *buf)
 {
     if (buf == NULL) {
@@ -82,10 +167,10 @@ buffer_t *buffer_get_specific(uint16_t headroom, uint16_t size, uint16_t minspac
 
     // Note - as well as this alloc+init, buffers can also be "realloced"
     // in buffer_headroom()
-    buf = malloc(sizeof(buffer_t) + total_size);
-    FATAL_ON(!buf, 2);
+    buf = buffer_alloc(total_size);
 
     buffer_count++;
+    total_size = buf->size;
     memset(buf, 0, sizeof(buffer_t));
     buf->buf_ptr = total_size - size;
     buf->buf_end = buf->buf_ptr;
@@ -119,17 +204,17 @@ buffer_t *buffer_headroom(buffer_t *buf, uint16_t size)
         /* This buffer isn't big enough at all - allocate a new block */
         // TODO - should we be giving them extra? probably
         uint32_t new_total = (curr_len + size + 3) & ~ 3;
-        new_buf = malloc(sizeof(buffer_t) + new_total);
-        FATAL_ON(!new_buf, 2);
+        new_buf = buffer_alloc(new_total);
+        new_total = new_buf->size;
         // Copy the buffer_t header
         *new_buf = *buf;
-        // Set new pointers, leaving specified headroom
-        new_buf->buf_ptr = size;
-        new_buf->buf_end = size + curr_len;
+        // Set new pointers, leaving at least the specified headroom
+        new_buf->buf_ptr = new_total - curr_len;
+        new_buf->buf_end = new_total;
         new_buf->size = new_total;
         // Copy the current data
         memcpy(buffer_data_pointer(new_buf), buffer_data_pointer(buf), curr_len);
-        free(buf);
+        buffer_release(buf);
         buf = new_buf;
     } else if (buf->buf_ptr < size) {
         /* This buffer is big enough, but not enough headroom - shuffle */
@@ -172,7 +257,7 @@ buffer_t *buffer_free(buffer_t *buf)
         }
 
         buf = buffer_free_route(buf);
-        free(buf);
+        buffer_release(buf);
 
     } else {
         tr_error("nullp F");
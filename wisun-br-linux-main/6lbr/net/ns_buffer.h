@@ -176,6 +176,7 @@ typedef struct buffer {
     uint16_t            offset;                 /*!< Offset indicator (used in some upward paths) */
     bool                ip_routed_up: 1;
     uint32_t            adaptation_timestamp;   /*!< Timestamp when buffer pushed to adaptation interface. Unit 100ms */
+    uint8_t             tx_class;               /*!< Adaptation layer service class (enum lowpan_tx_class) */
     buffer_link_info_t  link_specific;
     uint16_t            mpl_option_data_offset;
     buffer_options_t    options;                /*!< Additional signal info etc */
@@ -200,6 +201,17 @@ buffer_t *buffer_get_specific(uint16_t headroom, uint16_t size, uint16_t minspac
 /** Allocate memory for a minimal buffer (no headroom or extra space) */
 buffer_t *buffer_get_minimal(uint16_t size);
 
+struct buffer_pool_stats {
+    uint16_t size;              // size of the buffers of the pool
+    unsigned int hits;          // allocations served from the free list
+    unsigned int misses;        // allocations which needed a malloc()
+    unsigned int in_use;
+    unsigned int high_water;    // maximum of in_use
+};
+
+/** Statistics of the i-th pool, by increasing buffer size. NULL past the last pool */
+const struct buffer_pool_stats *buffer_pool_stats(int i);
+
 /** Free a buffer from the heap, and return NULL */
 buffer_t *buffer_free(buffer_t *buf);
 
@@ -30,7 +30,6 @@
 #include "app/wsbr_mac.h"
 #include "net/timers.h"
 #include "6lowpan/bootstraps/protocol_6lowpan.h"
-#include "6lowpan/fragmentation/cipv6_fragmenter.h"
 #include "6lowpan/lowpan_adaptation_interface.h"
 #include "6lowpan/mac/mac_helper.h"
 #include "ws/ws_bootstrap_6lbr.h"
@@ -103,6 +102,7 @@ void protocol_core_init(void)
     ws_timer_start(WS_TIMER_6LOWPAN_REACHABLE_TIME);
     ws_timer_start(WS_TIMER_WS_COMMON_FAST);
     ws_timer_start(WS_TIMER_WS_COMMON_SLOW);
+    ws_timer_start(WS_TIMER_STORAGE);
 }
 
 static void protocol_set_eui64(struct net_if *cur, uint8_t eui64[8])
@@ -125,7 +125,6 @@ void protocol_init(struct net_if *entry, struct rcp *rcp, int mtu)
     entry->zone_index[IPV6_SCOPE_REALM_LOCAL] = entry->id;
 
     lowpan_adaptation_interface_init(entry->id);
-    reassembly_interface_init(entry->id, 8, 5);
     memset(&entry->mac_parameters, 0, sizeof(arm_15_4_mac_parameters_t));
     entry->mac_parameters.mac_default_ffn_key_index = 0;
     entry->mac_parameters.mtu = mtu;
@@ -23,6 +23,8 @@
 #include "net/protocol.h"
 #include "mpl/mpl.h"
 #include "rpl/rpl.h"
+#include "common/key_value_storage.h"
+#include "common/mathutils.h"
 #include "common/memutils.h"
 #include "common/log.h"
 
@@ -30,6 +32,11 @@
 
 int g_monotonic_time_100ms = 0;
 
+// Timers store an absolute expiration tick. The earliest one is cached so
+// global ticks where nothing is due do not need to scan g_timers[].
+static uint64_t g_timer_tick = 0;
+static uint64_t g_timer_next_tick = UINT64_MAX;
+
 static void timer_update_monotonic_time(int ticks)
 {
     g_monotonic_time_100ms += ticks;
@@ -59,35 +66,61 @@ struct ws_timer g_timers[] = {
     timer_entry(6LOWPAN_NEIGHBOR_FAST,  ipv6_neighbour_cache_fast_timer,            100,                     true),
     timer_entry(6LOWPAN_CONTEXT,        lowpan_context_timer,                       100,                     true),
     timer_entry(6LOWPAN_REACHABLE_TIME, update_reachable_time,                      1000,                    true),
+    timer_entry(STORAGE,                storage_timer,                              1000,                    true),
     timer_entry(LPA,                    ws_mngt_lpa_timer_cb,                       0,                       false),
     timer_entry(LTS,                    ws_mngt_lts_timer_cb,                       0,                       true),
 };
 static_assert(ARRAY_SIZE(g_timers) == WS_TIMER_COUNT, "missing timer declarations");
 
+static void ws_timer_arm(enum timer_id id, int ticks)
+{
+    if (!ticks) {
+        g_timers[id].expire_tick = 0;
+        return;
+    }
+    g_timers[id].expire_tick = g_timer_tick + ticks;
+    g_timer_next_tick = MIN(g_timer_next_tick, g_timers[id].expire_tick);
+}
+
 void ws_timer_start(enum timer_id id)
 {
     BUG_ON(g_timers[id].period_ms % WS_TIMER_GLOBAL_PERIOD_MS);
-    g_timers[id].timeout = g_timers[id].period_ms / WS_TIMER_GLOBAL_PERIOD_MS;
+    ws_timer_arm(id, g_timers[id].period_ms / WS_TIMER_GLOBAL_PERIOD_MS);
+}
+
+// Timeout is rounded down to the global tick. The timer is not started if the
+// result is 0.
+void ws_timer_start_timeout(enum timer_id id, int timeout_ms)
+{
+    ws_timer_arm(id, timeout_ms / WS_TIMER_GLOBAL_PERIOD_MS);
 }
 
 void ws_timer_stop(enum timer_id id)
 {
-    g_timers[id].timeout = 0;
+    // g_timer_next_tick may become stale, it is fixed on the next expiration
+    g_timers[id].expire_tick = 0;
 }
 
 void ws_timer_global_tick()
 {
-    for (int i = 0; i < ARRAY_SIZE(g_timers); i++) {
-        if (!g_timers[i].timeout)
-            continue;
+    g_timer_tick++; // Always advance one tick at a time
+    if (g_timer_tick < g_timer_next_tick)
+        return;
 
-        g_timers[i].timeout--; // Always advance one tick at a time
-        if (g_timers[i].timeout)
+    for (int i = 0; i < ARRAY_SIZE(g_timers); i++) {
+        if (!g_timers[i].expire_tick || g_timers[i].expire_tick > g_timer_tick)
             continue;
 
+        g_timers[i].expire_tick = 0;
         g_timers[i].callback(1);
         TRACE(TR_TIMERS, "timer: %s", g_timers[i].trace_name);
         if (g_timers[i].periodic)
             ws_timer_start(i);
     }
+
+    // Callbacks may have started or stopped any timer
+    g_timer_next_tick = UINT64_MAX;
+    for (int i = 0; i < ARRAY_SIZE(g_timers); i++)
+        if (g_timers[i].expire_tick)
+            g_timer_next_tick = MIN(g_timer_next_tick, g_timers[i].expire_tick);
 }
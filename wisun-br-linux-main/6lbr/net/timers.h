@@ -15,6 +15,7 @@
 #define WS_TIMERS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define WS_TIMER_GLOBAL_PERIOD_MS 50
 
@@ -40,6 +41,7 @@ enum timer_id {
     WS_TIMER_PAE_FAST,
     WS_TIMER_PAE_SLOW,
     WS_TIMER_DHCPV6_SOCKET,
+    WS_TIMER_STORAGE,
     WS_TIMER_LPA,
     WS_TIMER_LTS,
     WS_TIMER_COUNT,
@@ -54,11 +56,12 @@ struct ws_timer {
     void (*callback)(int);
     int period_ms;
     bool periodic;
-    int timeout;
+    uint64_t expire_tick; // 0 if the timer is stopped
 };
 extern struct ws_timer g_timers[WS_TIMER_COUNT];
 
 void ws_timer_start(enum timer_id id);
+void ws_timer_start_timeout(enum timer_id id, int timeout_ms);
 void ws_timer_stop(enum timer_id id);
 
 void ws_timer_global_tick();
@@ -15,6 +15,7 @@
 #include <sys/socket.h>
 #include <netinet/icmp6.h>
 #include <netinet/in.h>
+#include <errno.h>
 
 #include "net/timers.h"
 #include "app/wsbr.h" // FIXME
@@ -28,9 +29,11 @@
 #include "common/sys_queue_extra.h"
 #include "common/time_extra.h"
 #include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/specs/icmpv6.h"
 #include "common/specs/rpl.h"
 #include "rpl_lollipop.h"
+#include "rpl_srh.h"
 #include "rpl.h"
 
 struct rpl_opt_target {
@@ -63,14 +66,19 @@ static const char *tr_icmp_rpl(uint8_t code)
     return val_to_str(code, rpl_codes, "unknown");
 }
 
-struct rpl_target *rpl_target_get(struct rpl_root *root, const uint8_t prefix[16])
+static const void *rpl_target_index_key(const void *entry)
 {
-    struct rpl_target *target;
+    return ((const struct rpl_target *)entry)->prefix;
+}
 
-    SLIST_FOREACH(target, &root->targets, link)
-        if (!memcmp(target->prefix, prefix, 16))
-            return target;
-    return NULL;
+static const struct hash_table_type rpl_target_index_type = {
+    .key     = rpl_target_index_key,
+    .key_len = 16,
+};
+
+struct rpl_target *rpl_target_get(struct rpl_root *root, const uint8_t prefix[16])
+{
+    return hash_table_get(&root->target_index, &rpl_target_index_type, prefix);
 }
 
 struct rpl_target *rpl_target_new(struct rpl_root *root, const uint8_t prefix[16])
@@ -79,6 +87,8 @@ struct rpl_target *rpl_target_new(struct rpl_root *root, const uint8_t prefix[16
 
     memcpy(target->prefix, prefix, 16);
     SLIST_INSERT_HEAD(&root->targets, target, link);
+    hash_table_insert(&root->target_index, &rpl_target_index_type, target);
+    root->srh_gen++;
     if (root->on_target_add)
         root->on_target_add(root, target);
     return target;
@@ -87,15 +97,18 @@ struct rpl_target *rpl_target_new(struct rpl_root *root, const uint8_t prefix[16
 void rpl_target_del(struct rpl_root *root, struct rpl_target *target)
 {
     TRACE(TR_RPL, "rpl: target  remove prefix=%s", tr_ipv6_prefix(target->prefix, 128));
+    hash_table_remove(&root->target_index, &rpl_target_index_type, target);
     SLIST_REMOVE(&root->targets, target, rpl_target, link);
+    root->srh_gen++;
     if (root->on_target_del)
         root->on_target_del(root, target);
+    free(target->srh_cache);
     free(target);
 }
 
 uint16_t rpl_target_count(struct rpl_root *root)
 {
-    return SLIST_SIZE(&root->targets, link);
+    return root->target_index.count;
 }
 
 struct rpl_transit *rpl_transit_preferred(struct rpl_root *root, struct rpl_target *target)
@@ -384,6 +397,7 @@ static void rpl_transit_update(struct rpl_root *root,
     bool updated_lifetime = false;
     bool updated_transit = false;
     struct rpl_transit transit;
+    struct rpl_target target_old;
     struct rpl_target *target;
 
     BUG_ON(opt_target->prefix_len != 128);
@@ -401,6 +415,7 @@ static void rpl_transit_update(struct rpl_root *root,
         TRACE(TR_RPL, "rpl: target  new    prefix=%s path-seq=%u external=%u",
               tr_ipv6_prefix(target->prefix, 128), target->path_seq, target->external);
     }
+    target_old = *target;
 
     if (root->compat) {
         target->path_seq = opt_transit->path_seq;
@@ -444,6 +459,10 @@ static void rpl_transit_update(struct rpl_root *root,
         TRACE(TR_RPL, "rpl: transit new    target=%s parent=%s path-ctl-bit=%u",
               tr_ipv6_prefix(target->prefix, 128), tr_ipv6(target->transits[i].parent), i);
     }
+    // A new Path Sequence with the same parents does not change the route
+    if (target->external != target_old.external ||
+        memcmp(target->transits, target_old.transits, sizeof(target->transits)))
+        target->srh_gen++;
     if ((updated_lifetime || updated_transit) && root->on_target_update)
         root->on_target_update(root, target, updated_transit);
 }
@@ -595,6 +614,7 @@ void rpl_recv_srh_err(struct rpl_root *root,
     for (uint8_t i = 0; i < root->pcs + 1; i++) {
         if (!memcmp(target->transits[i].parent, src, 16)) {
             memset(target->transits + i, 0, sizeof(struct rpl_transit));
+            target->srh_gen++;
             updated = true;
             TRACE(TR_RPL, "rpl: transit remove target=%s parent=%s path-ctl-bit=%u",
                   tr_ipv6_prefix(dst, 128), tr_ipv6(src), i);
@@ -644,7 +664,7 @@ static void rpl_recv_dispatch(struct rpl_root *root, const uint8_t *pkt, size_t
     }
 }
 
-void rpl_recv(struct rpl_root *root)
+bool rpl_recv(struct rpl_root *root)
 {
     uint8_t cmsgbuf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
     struct sockaddr_in6 src;
@@ -666,10 +686,12 @@ void rpl_recv(struct rpl_root *root)
     ssize_t size;
 
     size = xrecvmsg(root->sockfd, &msg, 0);
+    if (size < 0 && errno == EAGAIN)
+        return false;
     FATAL_ON(size < 0, 2, "%s: recvmsg: %m", __func__);
     if (msg.msg_namelen != sizeof(src) || src.sin6_family != AF_INET6) {
         TRACE(TR_DROP, "drop %-9s: source address not IPv6", "rpl");
-        return;
+        return true;
     }
     cmsg = CMSG_FIRSTHDR(&msg);
     BUG_ON(!cmsg);
@@ -679,6 +701,7 @@ void rpl_recv(struct rpl_root *root)
     pktinfo = (struct in6_pktinfo *)CMSG_DATA(cmsg);
     rpl_recv_dispatch(root, iov.iov_base, size,
                       src.sin6_addr.s6_addr, pktinfo->ipi6_addr.s6_addr);
+    return true;
 }
 
 void rpl_start(struct rpl_root *root, const char ifname[IF_NAMESIZE])
@@ -740,6 +763,7 @@ void rpl_timer(int ticks)
             TRACE(TR_RPL, "rpl: transit expire target=%s parent=%s path-ctl-bit=%u",
                   tr_ipv6_prefix(target->prefix, 128), tr_ipv6(target->transits[i].parent), i);
             memset(target->transits + i, 0, sizeof(struct rpl_transit));
+            target->srh_gen++;
             updated = false;
         }
         if (!memzcmp(target->transits, sizeof(target->transits)))
@@ -16,9 +16,11 @@
 
 #include <sys/queue.h>
 #include <net/if.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include "common/hash_table.h"
 #include "common/trickle.h"
 
 /*
@@ -35,6 +37,8 @@
  *
  * Once started, the caller has to poll (with poll() or equivalent)
  * rpl_root->sockfd for any incoming packets, and call rpl_recv() when ready.
+ * If rpl_root->sockfd is non-blocking, rpl_recv() returns false once there is
+ * nothing left to read.
  * Additionally rpl_timer() must be setup as a timer callback with the timer ID
  * WS_TIMER_RPL in order to run the trickle algorithm for DIO packets.
  *
@@ -67,6 +71,8 @@
  * bit. The handling of path control bits is also made easier that way.
  */
 
+struct rpl_srh_cache;
+
 struct rpl_transit {
     uint32_t path_lifetime_s;
     uint8_t  parent[16];
@@ -84,6 +90,12 @@ struct rpl_target {
     // corresponds to the most preferred parent). An unassigned path control
     // bit maps to a 0-initialized transit.
     struct rpl_transit transits[8];
+    // Allocated on first downward packet to this target, see rpl_srh_get()
+    struct rpl_srh_cache *srh_cache;
+    // Incremented each time the transits or the external flag change. Source
+    // routing headers going through this target built with an older
+    // generation are stale.
+    uint32_t srh_gen;
 
     SLIST_ENTRY(rpl_target) link;
 };
@@ -123,12 +135,19 @@ struct rpl_root {
     bool compat;
 
     struct rpl_target_list targets;
+    // Index over targets keyed on the prefix, so rpl_target_get() does not
+    // need to walk the list.
+    struct hash_table target_index;
+    // Incremented each time a target is added or removed. Source routing
+    // headers cached with an older generation are stale. Transit changes only
+    // invalidate the paths going through the target, see rpl_target.srh_gen.
+    uint32_t srh_gen;
 };
 
 extern const uint8_t rpl_all_nodes[16]; // ff02::1a
 
 void rpl_start(struct rpl_root *root, const char ifname[IF_NAMESIZE]);
-void rpl_recv(struct rpl_root *root);
+bool rpl_recv(struct rpl_root *root);
 void rpl_timer(int ticks);
 
 void rpl_dodag_version_inc(struct rpl_root *root);
@@ -71,13 +71,13 @@ bool rpl_glue_process_rpi(struct rpl_root *root, struct buffer *buf,
 
 static buffer_t *rpl_glue_srh_provider(buffer_t *buf, ipv6_exthdr_stage_e stage, int16_t *res)
 {
-    __attribute__((cleanup(iobuf_free))) struct iobuf_write srh_buf = { };
     struct rpl_root *root = buf->route->route_info.info;
     const uint8_t *rpl_dst = buf->dst_sa.address;
+    const struct rpl_srh_cache *srh;
     struct rpl_transit *transit;
-    struct rpl_srh_decmpr srh;
     struct rpl_target *target;
     const uint8_t *nxthop;
+    uint8_t *ptr;
 
     *res = 0;
 
@@ -109,23 +109,26 @@ static buffer_t *rpl_glue_srh_provider(buffer_t *buf, ipv6_exthdr_stage_e stage,
         }
     }
 
-    if (rpl_srh_build(root, rpl_dst, &srh, &nxthop) < 0) {
+    srh = rpl_srh_get(root, target);
+    if (srh->seg_count < 0) {
         *res = -1;
         return buf;
     }
-    if (!srh.seg_count)
+    if (!srh->seg_count)
         return buf; // TODO: add hop-by-hop option
-    rpl_srh_push(&srh_buf, &srh, nxthop, buf->options.type, root->compat);
+    nxthop = srh->nxthop;
 
     switch (stage) {
     case IPV6_EXTHDR_SIZE:
-        *res = srh_buf.len;
+        *res = srh->len;
         return buf;
     case IPV6_EXTHDR_INSERT:
-        buf = buffer_headroom(buf, srh_buf.len);
+        buf = buffer_headroom(buf, srh->len);
         if (!buf)
             return NULL;
-        memcpy(buffer_data_reserve_header(buf, srh_buf.len), srh_buf.data, srh_buf.len);
+        ptr = buffer_data_reserve_header(buf, srh->len);
+        memcpy(ptr, srh->data, srh->len);
+        ptr[0] = buf->options.type; // Next Header
         buf->route->ip_dest = nxthop;
         buf->options.type = IPV6_NH_ROUTING;
         buf->options.ip_extflags |= IPEXT_SRH_RPL;
@@ -147,10 +150,9 @@ static buffer_t *rpl_glue_srh_provider(buffer_t *buf, ipv6_exthdr_stage_e stage,
 static bool rpl_glue_nxthop(const uint8_t dst[16], ipv6_route_info_t *route)
 {
     struct rpl_root *root = route->info;
-    const uint8_t *rpl_dst = dst;
+    const struct rpl_srh_cache *srh;
     struct rpl_transit *transit;
     struct rpl_target *target;
-    const uint8_t *nxthop;
 
     target = rpl_target_get(root, dst);
     if (!target)
@@ -159,13 +161,16 @@ static bool rpl_glue_nxthop(const uint8_t dst[16], ipv6_route_info_t *route)
         transit = rpl_transit_preferred(root, target);
         if (!transit)
             return false;
-        rpl_dst = transit->parent;
+        target = rpl_target_get(root, transit->parent);
+        if (!target)
+            return false;
     }
 
-    if (rpl_srh_build(root, rpl_dst, NULL, &nxthop) < 0)
+    srh = rpl_srh_get(root, target);
+    if (srh->seg_count < 0)
         return false;
 
-    memcpy(route->next_hop_addr, nxthop, 16);
+    memcpy(route->next_hop_addr, srh->nxthop, 16);
     return true;
 }
 
@@ -17,13 +17,16 @@
 #include "common/iobuf.h"
 #include "common/log.h"
 #include "common/mathutils.h"
+#include "common/memutils.h"
 #include "common/specs/rpl.h"
 #include "common/specs/ipv6.h"
 #include "rpl_srh.h"
 #include "rpl.h"
 
-int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
-                  struct rpl_srh_decmpr *srh, const uint8_t **nxthop_ret)
+// When cache is set, the targets walked through are recorded in its chain
+static int rpl_srh_build_chain(struct rpl_root *root, const uint8_t dst[16],
+                               struct rpl_srh_decmpr *srh, const uint8_t **nxthop_ret,
+                               struct rpl_srh_cache *cache)
 {
     const uint8_t *seg_list[WS_RPL_SRH_MAXSEG];
     struct rpl_transit *transit;
@@ -38,6 +41,12 @@ int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
             TRACE(TR_TX_ABORT, "tx-abort: rpl srh unknown target %s", tr_ipv6(nxthop));
             return -1;
         }
+        if (cache) {
+            BUG_ON(cache->chain_len >= ARRAY_SIZE(cache->chain));
+            cache->chain[cache->chain_len] = target;
+            cache->chain_gen[cache->chain_len] = target->srh_gen;
+            cache->chain_len++;
+        }
         if (target->external) {
             TRACE(TR_TX_ABORT, "tx-abort: rpl srh external target %s", tr_ipv6(target->prefix));
             return -1;
@@ -50,7 +59,7 @@ int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
         }
         if (!memcmp(transit->parent, root->dodag_id, 16))
             break;
-        if (seg_count > WS_RPL_SRH_MAXSEG) {
+        if (seg_count >= WS_RPL_SRH_MAXSEG) {
             TRACE(TR_TX_ABORT, "tx-abort: rpl srh > %u hops", WS_RPL_SRH_MAXSEG);
             return -1;
         }
@@ -75,6 +84,55 @@ int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
     return seg_count;
 }
 
+int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
+                  struct rpl_srh_decmpr *srh, const uint8_t **nxthop_ret)
+{
+    return rpl_srh_build_chain(root, dst, srh, nxthop_ret, NULL);
+}
+
+/*
+ * Targets are only freed along with a root generation change, so the chain
+ * can be dereferenced once the root generation has been checked.
+ */
+static bool rpl_srh_cache_valid(const struct rpl_root *root, const struct rpl_srh_cache *cache)
+{
+    if (cache->gen != root->srh_gen)
+        return false;
+    for (uint8_t i = 0; i < cache->chain_len; i++)
+        if (cache->chain[i]->srh_gen != cache->chain_gen[i])
+            return false;
+    return true;
+}
+
+const struct rpl_srh_cache *rpl_srh_get(struct rpl_root *root, struct rpl_target *target)
+{
+    struct rpl_srh_cache *cache = target->srh_cache;
+    struct iobuf_write buf = { };
+    struct rpl_srh_decmpr srh;
+    const uint8_t *nxthop;
+
+    if (!cache)
+        cache = target->srh_cache = zalloc(sizeof(struct rpl_srh_cache));
+    else if (rpl_srh_cache_valid(root, cache))
+        return cache;
+
+    cache->gen = root->srh_gen;
+    cache->chain_len = 0;
+    cache->len = 0;
+    cache->seg_count = rpl_srh_build_chain(root, target->prefix, &srh, &nxthop, cache);
+    if (cache->seg_count < 0)
+        return cache;
+    memcpy(cache->nxthop, nxthop, 16);
+    if (!cache->seg_count)
+        return cache;
+    rpl_srh_push(&buf, &srh, nxthop, 0, root->compat);
+    BUG_ON(buf.len > sizeof(cache->data));
+    memcpy(cache->data, buf.data, buf.len);
+    cache->len = buf.len;
+    iobuf_free(&buf);
+    return cache;
+}
+
 // RFC 6554 - 3. Format of the RPL Routing Header
 void rpl_srh_push(struct iobuf_write *buf, const struct rpl_srh_decmpr *srh,
                   const uint8_t dst[16], uint8_t nxthdr, bool cmpri_eq_cmpre)
@@ -32,8 +32,26 @@ struct rpl_srh_decmpr {
     uint8_t seg_list[WS_RPL_SRH_MAXSEG][16];
 };
 
+// Compressed source routing header towards a target, rebuilt only when the
+// root generation or the generation of a target on the path changes.
+struct rpl_srh_cache {
+    uint32_t gen;
+    // Targets walked through by rpl_srh_build(), from the destination upwards
+    struct rpl_target *chain[WS_RPL_SRH_MAXSEG + 1];
+    uint32_t chain_gen[WS_RPL_SRH_MAXSEG + 1];
+    uint8_t chain_len;
+    int seg_count; // Result of rpl_srh_build(), negative on failure
+    uint8_t nxthop[16];
+    // Next Header (first byte) must be set by the caller
+    uint8_t data[8 + 16 * WS_RPL_SRH_MAXSEG];
+    uint16_t len;
+};
+
+struct rpl_target;
+
 int rpl_srh_build(struct rpl_root *root, const uint8_t dst[16],
                   struct rpl_srh_decmpr *srh, const uint8_t **nxthop);
+const struct rpl_srh_cache *rpl_srh_get(struct rpl_root *root, struct rpl_target *target);
 void rpl_srh_push(struct iobuf_write *buf, const struct rpl_srh_decmpr *srh,
                   const uint8_t dst[16], uint8_t nxthdr, bool cmpri_eq_cmpre);
 
@@ -14,7 +14,6 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <fnmatch.h>
-#include <glob.h>
 #include <unistd.h>
 #include <limits.h>
 #include <stdio.h>
@@ -49,7 +48,7 @@ void rpl_storage_load_config(struct rpl_root *root, const char *filename)
     struct storage_parse_info *nvm;
     int ret;
 
-    nvm = storage_open(filename, "r");
+    nvm = storage_open_prefix(filename, "r");
     if (!nvm) {
         WARN("%s %s failure", __func__, filename);
         return;
@@ -140,7 +139,7 @@ void rpl_storage_load_target(struct rpl_root *root, const char *filename)
     target = rpl_target_new(root, prefix);
     BUG_ON(!target);
 
-    nvm = storage_open(filename, "r");
+    nvm = storage_open_prefix(filename, "r");
     if (!nvm) {
         WARN("%s %s failure", __func__, filename);
         return;
@@ -171,23 +170,16 @@ void rpl_storage_load_target(struct rpl_root *root, const char *filename)
 
 void rpl_storage_load(struct rpl_root *root)
 {
-    char globexpr[PATH_MAX];
-    glob_t globbuf;
-    int ret;
+    char **filenames;
 
     if (!g_storage_prefix)
         return;
-    snprintf(globexpr, sizeof(globexpr), "%s%s", g_storage_prefix, "rpl-*");
-    ret = glob(globexpr, 0, NULL, &globbuf);
-    if (ret && ret != GLOB_NOMATCH)
-        WARN("%s: glob %s returned %u", __func__, globexpr, ret);
-    if (ret)
-        return;
-    for (int i = 0; globbuf.gl_pathv[i]; i++) {
-        if (strstr(globbuf.gl_pathv[i], "rpl-config"))
-            rpl_storage_load_config(root, globbuf.gl_pathv[i]);
+    filenames = storage_glob("rpl-*");
+    for (int i = 0; filenames[i]; i++) {
+        if (strstr(filenames[i], "rpl-config"))
+            rpl_storage_load_config(root, filenames[i]);
         else
-            rpl_storage_load_target(root, globbuf.gl_pathv[i]);
+            rpl_storage_load_target(root, filenames[i]);
     }
-    globfree(&globbuf);
+    storage_glob_free(filenames);
 }
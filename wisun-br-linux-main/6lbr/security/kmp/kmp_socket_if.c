@@ -239,7 +239,7 @@ int kmp_socket_if_get_pae_socket_fd()
     return -1;
 }
 
-void kmp_socket_if_pae_socket_cb(int fd)
+bool kmp_socket_if_pae_socket_cb(int fd)
 {
     kmp_socket_if_t *socket_if = g_kmp_socket_if_instances[KMP_RELAY_INSTANCE_INDEX];
     uint8_t connection_num = 0;
@@ -248,16 +248,18 @@ void kmp_socket_if_pae_socket_cb(int fd)
     uint8_t *pdu = NULL;
 
     data_len = xrecv(fd, data, sizeof(data), 0);
-    if (data_len <= 0)
-        return;
+    if (data_len < 0)
+        return false;
+    if (!data_len)
+        return true;
 
     if (!socket_if) {
-        return;
+        return true;
     }
 
     pdu = malloc(data_len);
     if (!pdu)
-        return;
+        return true;
 
     memcpy(pdu, data, data_len);
 
@@ -278,13 +280,14 @@ void kmp_socket_if_pae_socket_cb(int fd)
         type = kmp_api_type_from_id_get(*data_ptr++);
         if (type == KMP_TYPE_NONE) {
             free(pdu);
-            return;
+            return true;
         }
         data_len -= SOCKET_IF_HEADER_SIZE;
     }
 
     kmp_service_msg_if_receive(socket_if->kmp_service, socket_if->instance_id, type, &addr, data_ptr, data_len, connection_num);
     free(pdu);
+    return true;
 }
 
 int kmp_socket_if_get_radius_sockfd()
@@ -295,7 +298,7 @@ int kmp_socket_if_get_radius_sockfd()
     return -1;
 }
 
-uint8_t kmp_socket_if_radius_socket_cb(int fd)
+bool kmp_socket_if_radius_socket_cb(int fd)
 {
     ssize_t size;
     uint8_t radius_recv_buf[4096];
@@ -305,14 +308,14 @@ uint8_t kmp_socket_if_radius_socket_cb(int fd)
     kmp_type_e type = KMP_TYPE_NONE;
 
     if (!socket_if) {
-        return -1;
+        return false;
     }
 
     size = xrecv(fd, radius_recv_buf, sizeof(radius_recv_buf), 0);
     if (size < 0)
-        return -1;
+        return false;
 
     kmp_service_msg_if_receive(socket_if->kmp_service, socket_if->instance_id, type, &addr, radius_recv_buf, size, connection_num);
 
-    return size;
+    return true;
 }
@@ -37,7 +37,8 @@ typedef struct kmp_service kmp_service_t;
  */
 
 int kmp_socket_if_get_pae_socket_fd();
-void kmp_socket_if_pae_socket_cb(int fd);
+// Return false once the socket has no more data
+bool kmp_socket_if_pae_socket_cb(int fd);
 
 /**
  * kmp_socket_if_register register socket interface to KMP service
@@ -82,7 +83,8 @@ int8_t kmp_socket_if_unregister(kmp_service_t *service);
  */
 
 int kmp_socket_if_get_radius_sockfd();
-uint8_t kmp_socket_if_radius_socket_cb(int fd);
+// Return false once the socket has no more data
+bool kmp_socket_if_radius_socket_cb(int fd);
 
 
 #endif
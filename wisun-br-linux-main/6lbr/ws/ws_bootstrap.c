@@ -147,7 +147,7 @@ struct ws_neigh *ws_bootstrap_neighbor_add(struct net_if *net_if, const uint8_t
                                 net_if->ws_info.key_index_mask);
 
     BUG_ON(!ws_neigh);
-    if (role == WS_NR_ROLE_LFN && !g_timers[WS_TIMER_LTS].timeout)
+    if (role == WS_NR_ROLE_LFN && !g_timers[WS_TIMER_LTS].expire_tick)
         ws_timer_start(WS_TIMER_LTS);
 
     ipv6_neighbor = ipv6_neighbour_lookup_gua_by_eui64(&net_if->ipv6_neighbour_cache, eui64);
@@ -443,4 +443,5 @@ void ws_bootstrap_packet_congestion_init(struct net_if *cur)
             cur->random_early_detection.threshold_max,
             cur->random_early_detection.drop_max_probability,
             cur->random_early_detection.weight, packet_per_seconds);
+    lowpan_adaptation_congestion_init(cur->id, &cur->random_early_detection);
 }
@@ -112,7 +112,7 @@ static eapol_auth_relay_t *ws_eapol_auth_relay_get(struct net_if *interface_ptr)
     return g_eapol_auth_relay;
 }
 
-void ws_eapol_auth_relay_socket_cb(int fd)
+bool ws_eapol_auth_relay_socket_cb(int fd)
 {
     ssize_t socket_data_len;
     uint8_t data[2048];
@@ -124,16 +124,18 @@ void ws_eapol_auth_relay_socket_cb(int fd)
     eapol_auth_relay_t *eapol_auth_relay = g_eapol_auth_relay;
 
     if (!eapol_auth_relay) {
-        return;
+        return false;
     }
 
     socket_data_len = xrecvfrom(fd, data, sizeof(data), 0, (struct sockaddr *) &sockaddr, &sockaddr_len);
-    if (socket_data_len <= 0)
-        return;
+    if (socket_data_len < 0)
+        return false;
+    if (!socket_data_len)
+        return true;
 
     socket_pdu = malloc(socket_data_len);
     if (!socket_pdu)
-        return;
+        return true;
 
     memcpy(socket_pdu, data, socket_data_len);
 
@@ -159,7 +161,7 @@ void ws_eapol_auth_relay_socket_cb(int fd)
          */
         if (data_len == 1 && !addr_ipv6_equal(relay_ip_addr.address, eapol_auth_relay->relay_addr.address)) {
             free(socket_pdu);
-            return;
+            return true;
         }
         ws_eapol_relay_lib_send_to_relay(eapol_auth_relay->socket_id, eui_64, &relay_ip_addr,
                                          ptr, data_len);
@@ -171,6 +173,7 @@ void ws_eapol_auth_relay_socket_cb(int fd)
                                         ptr + 8, socket_data_len - 8);
         free(socket_pdu);
     }
+    return true;
 }
 
 static int8_t ws_eapol_auth_relay_send_to_kmp(eapol_auth_relay_t *eapol_auth_relay, const uint8_t *eui_64, const uint8_t *ip_addr, uint16_t port, const void *data, uint16_t data_len)
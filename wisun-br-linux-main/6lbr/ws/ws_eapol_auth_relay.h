@@ -18,6 +18,7 @@
 #ifndef WS_EAPOL_AUTH_RELAY_H_
 #define WS_EAPOL_AUTH_RELAY_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /*
@@ -32,7 +33,8 @@
 struct net_if;
 
 int ws_eapol_auth_relay_get_socket_fd();
-void ws_eapol_auth_relay_socket_cb(int fd);
+// Return false once the socket has no more data
+bool ws_eapol_auth_relay_socket_cb(int fd);
 
 /**
  * ws_eapol_auth_relay_start start authenticator relay
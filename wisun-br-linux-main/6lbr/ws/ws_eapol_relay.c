@@ -144,35 +144,38 @@ static int8_t ws_eapol_relay_eapol_pdu_receive(struct net_if *interface_ptr, con
     return 0;
 }
 
-void ws_eapol_relay_socket_cb(int fd)
+bool ws_eapol_relay_socket_cb(int fd)
 {
     uint8_t *socket_pdu = NULL;
     ssize_t data_len;
     uint8_t data[2048];
 
     data_len = xrecv(fd, data, sizeof(data), 0);
-    if (data_len <= 0)
-        return;
+    if (data_len < 0)
+        return false;
+    if (!data_len)
+        return true;
 
     eapol_relay_t *eapol_relay = g_eapol_relay;
 
     if (!eapol_relay) {
-        return;
+        return true;
     }
     socket_pdu = malloc(data_len);
     if (!socket_pdu)
-        return;
+        return true;
 
     memcpy(socket_pdu, data, data_len);
 
     // EAPOL PDU data length is zero (message contains only supplicant EUI-64 and KMP ID)
     if (data_len == 9) {
         free(socket_pdu);
-        return;
+        return true;
     }
 
     //First 8 byte is EUID64 and rsr payload
     if (data_len < 8 || ws_eapol_pdu_send_to_mpx(eapol_relay->interface_ptr, socket_pdu, socket_pdu + 8, data_len - 8, socket_pdu, NULL, 0) < 0) {
         free(socket_pdu);
     }
+    return true;
 }
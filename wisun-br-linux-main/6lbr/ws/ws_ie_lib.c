@@ -583,20 +583,44 @@ void ws_wp_nested_jm_write(struct iobuf_write *buf, const struct ws_jm_ie *jm)
     ieee802154_ie_fill_len_nested(buf, offset, false);
 }
 
+/*
+ * A received frame is decoded by calling several ws_wh_*_read() and
+ * ws_wp_nested_*_read() on the same IE lists. The last IE lists seen are
+ * indexed so each list is only parsed once per frame. The buffers holding
+ * received frames are reused, so ws_ie_index_reset() must be called before
+ * decoding a new frame.
+ */
+static struct {
+    struct ieee802154_ie_index wh;
+    struct ieee802154_ie_index wp;
+    bool wh_valid;
+    bool wp_valid;
+} ws_ie_index;
+
+void ws_ie_index_reset(void)
+{
+    ws_ie_index.wh_valid = false;
+    ws_ie_index.wp_valid = false;
+}
+
 static void ws_wh_find_subid(const uint8_t *data, uint16_t length, uint8_t subid, struct iobuf_read *wh_content)
 {
-    const uint8_t *end = data + length;
+    if (!ws_ie_index.wh_valid || ws_ie_index.wh.data != data || ws_ie_index.wh.len != length) {
+        ieee802154_ie_index_header(&ws_ie_index.wh, data, length, IEEE802154_IE_ID_WH);
+        ws_ie_index.wh_valid = true;
+    }
+    ieee802154_ie_index_find_header(&ws_ie_index.wh, subid, wh_content);
+    iobuf_pop_u8(wh_content);
+}
 
-    do {
-        ieee802154_ie_find_header(data, length, IEEE802154_IE_ID_WH, wh_content);
-        if (iobuf_pop_u8(wh_content) == subid)
-            return;
-        if (wh_content->err)
-            return;
-        length -= wh_content->data + wh_content->data_size - data;
-        data = wh_content->data + wh_content->data_size;
-    } while (data < end);
-    wh_content->err = true;
+static void ws_wp_nested_find(const uint8_t *data, uint16_t length, uint8_t id,
+                              struct iobuf_read *ie_content, bool is_long)
+{
+    if (!ws_ie_index.wp_valid || ws_ie_index.wp.data != data || ws_ie_index.wp.len != length) {
+        ieee802154_ie_index_nested(&ws_ie_index.wp, data, length);
+        ws_ie_index.wp_valid = true;
+    }
+    ieee802154_ie_index_find_nested(&ws_ie_index.wp, id, ie_content, is_long);
 }
 
 bool ws_wh_utt_read(const uint8_t *data, uint16_t length, struct ws_utt_ie *utt_ie)
@@ -832,7 +856,7 @@ bool ws_wp_nested_us_read(const uint8_t *data, uint16_t length, struct ws_us_ie
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_US, &ie_buf, true);
+    ws_wp_nested_find(data, length, WS_WPIE_US, &ie_buf, true);
     us_ie->dwell_interval  = iobuf_pop_u8(&ie_buf);
     us_ie->clock_drift     = iobuf_pop_u8(&ie_buf);
     us_ie->timing_accuracy = iobuf_pop_u8(&ie_buf);
@@ -851,7 +875,7 @@ bool ws_wp_nested_bs_read(const uint8_t *data, uint16_t length, struct ws_bs_ie
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_BS, &ie_buf, true);
+    ws_wp_nested_find(data, length, WS_WPIE_BS, &ie_buf, true);
     bs_ie->broadcast_interval            = iobuf_pop_le32(&ie_buf);
     bs_ie->broadcast_schedule_identifier = iobuf_pop_le16(&ie_buf);
     bs_ie->dwell_interval                = iobuf_pop_u8(&ie_buf);
@@ -872,7 +896,7 @@ bool ws_wp_nested_pan_read(const uint8_t *data, uint16_t length, struct ws_pan_i
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_PAN, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_PAN, &ie_buf, false);
     pan_ie->pan_size = iobuf_pop_le16(&ie_buf);
     pan_ie->routing_cost = iobuf_pop_le16(&ie_buf);
     tmp8 = iobuf_pop_u8(&ie_buf);
@@ -887,7 +911,7 @@ bool ws_wp_nested_panver_read(const uint8_t *data, uint16_t length, uint16_t *pa
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_PANVER, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_PANVER, &ie_buf, false);
     *pan_version = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
 }
@@ -896,7 +920,7 @@ bool ws_wp_nested_gtkhash_read(const uint8_t *data, uint16_t length, gtkhash_t g
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_GTKHASH, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_GTKHASH, &ie_buf, false);
     iobuf_pop_data(&ie_buf, (uint8_t *)gtkhash, 4 * 8);
     return !ie_buf.err;
 }
@@ -905,7 +929,7 @@ bool ws_wp_nested_netname_read(const uint8_t *data, uint16_t length, struct ws_w
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_NETNAME, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_NETNAME, &ie_buf, false);
     network_name->network_name_length = iobuf_remaining_size(&ie_buf);
     network_name->network_name = iobuf_ptr(&ie_buf);
     if (network_name->network_name_length > 32)
@@ -918,7 +942,7 @@ bool ws_wp_nested_pom_read(const uint8_t *data, uint16_t length, struct ws_pom_i
     struct iobuf_read ie_buf;
     uint8_t tmp8;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_POM, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_POM, &ie_buf, false);
     tmp8 = iobuf_pop_u8(&ie_buf);
     pom_ie->phy_op_mode_number  = FIELD_GET(WS_WPIE_POM_PHY_OP_MODE_NUMBER_MASK, tmp8);
     pom_ie->mdr_command_capable = FIELD_GET(WS_WPIE_POM_MDR_CAPABLE_MASK,        tmp8);
@@ -930,7 +954,7 @@ bool ws_wp_nested_lfnver_read(const uint8_t *data, uint16_t length, struct ws_lf
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_LFNVER, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_LFNVER, &ie_buf, false);
     ws_lfnver->lfn_version = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
 }
@@ -940,7 +964,7 @@ bool ws_wp_nested_lgtkhash_read(const uint8_t *data, uint16_t length, gtkhash_t
     struct iobuf_read ie_buf;
     unsigned valid_hashs;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_LGTKHASH, &ie_buf, false);
+    ws_wp_nested_find(data, length, WS_WPIE_LGTKHASH, &ie_buf, false);
     valid_hashs = FIELD_GET(WS_WPIE_LGTKHASH_INCLUDE_LGTK0_MASK |
                             WS_WPIE_LGTKHASH_INCLUDE_LGTK1_MASK |
                             WS_WPIE_LGTKHASH_INCLUDE_LGTK2_MASK, *data);
@@ -958,7 +982,7 @@ bool ws_wp_nested_lbats_read(const uint8_t *data, uint16_t length, struct ws_lba
 {
     struct iobuf_read ie_buf;
 
-    ieee802154_ie_find_nested(data, length, WS_WPIE_LBATS, &ie_buf, true);
+    ws_wp_nested_find(data, length, WS_WPIE_LBATS, &ie_buf, true);
     lbats_ie->additional_transmissions = iobuf_pop_u8(&ie_buf);
     lbats_ie->next_transmit_delay      = iobuf_pop_le16(&ie_buf);
     return !ie_buf.err;
@@ -241,6 +241,7 @@ void   ws_wh_lto_write(struct iobuf_write *buf, uint24_t offset, uint24_t adjust
 void ws_wh_panid_write(struct iobuf_write *buf, uint16_t panid);
 void   ws_wh_lbc_write(struct iobuf_write *buf, uint24_t interval, uint8_t sync_period);
 
+void ws_ie_index_reset(void);
 
 bool ws_wh_utt_read(const uint8_t *data, uint16_t length, struct ws_utt_ie *utt_ie);
 bool ws_wh_bt_read(const uint8_t *data, uint16_t length, struct ws_bt_ie *bt_ie);
@@ -125,6 +125,33 @@ typedef struct temp_entriest {
     bool                            active_eapol_session: 1;        /**< Indicating active EAPOL message */
 } temp_entriest_t;
 
+/*
+ * Content of the IEs built by ws_llc_prepare_ie() which can change while the
+ * interface is running. The FHSS and PHY configurations are only set before
+ * the interface starts so they are not part of the key.
+ */
+struct llc_ie_cache_key {
+    struct wh_ie_list wh_ies;
+    struct wp_ie_list wp_ies;
+    uint16_t pan_size;
+    uint16_t routing_cost;
+    uint16_t pan_version;
+    uint16_t lfn_version;
+    uint8_t  fan_tps_version;
+    struct ws_jm_ie jm;
+    int pan_id;
+    gtkhash_t gtkhash[4];
+    gtkhash_t lgtkhash[3];
+    int8_t lgtk_index;
+};
+
+struct llc_ie_cache {
+    bool valid;
+    struct llc_ie_cache_key key;
+    struct iobuf_write ie_buf_header;
+    struct iobuf_write ie_buf_payload;
+};
+
 /** EDFE response and Enhanced ACK data length */
 
 typedef struct llc_data_base {
@@ -143,6 +170,7 @@ typedef struct llc_data_base {
     struct iobuf_write              ws_enhanced_response_elements;
     struct iovec                    ws_header_vector;
     bool                            high_priority_mode;
+    struct llc_ie_cache             ie_cache[16];                   /**< IEs last built by ws_llc_prepare_ie(), indexed by frame type */
     struct net_if *interface_ptr;                 /**< List link entry */
 } llc_data_base_t;
 
@@ -493,6 +521,7 @@ void ws_llc_mac_confirm_cb(struct net_if *net_if, const mcps_data_cnf_t *data,
     struct llc_message *msg;
     time_t tx_confirm_duration;
 
+    ws_ie_index_reset();
     base = ws_llc_discover_by_interface(net_if);
     if (!base)
         return;
@@ -1022,6 +1051,7 @@ void ws_llc_mac_indication_cb(struct net_if *net_if, struct mcps_data_ind *data,
     bool has_utt, has_lutt;
     uint8_t frame_type;
 
+    ws_ie_index_reset();
     ws_trace_llc_mac_ind(data, ie_ext);
 
     has_utt  = ws_wh_utt_read(ie_ext->headerIeList, ie_ext->headerIeListLength, &ie_utt);
@@ -1079,120 +1109,195 @@ void ws_llc_mac_indication_cb(struct net_if *net_if, struct mcps_data_ind *data,
         TRACE(TR_DROP, "drop %-9s: unsupported frame type (0x%02x)", "15.4", frame_type);
     }
 }
-static void ws_llc_prepare_ie(llc_data_base_t *base, llc_message_t *msg,
-                              const struct wh_ie_list *wh_ies,
-                              const struct wp_ie_list *wp_ies)
+static void ws_llc_write_ie(llc_data_base_t *base, uint8_t frame_type, uint16_t pan_size,
+                            const struct wh_ie_list *wh_ies,
+                            const struct wp_ie_list *wp_ies,
+                            struct iobuf_write *ie_buf_header,
+                            struct iobuf_write *ie_buf_payload)
 {
     struct ws_info *info = &base->interface_ptr->ws_info;
-    uint16_t pan_size = (info->pan_information.test_pan_size == -1) ?
-                         rpl_target_count(&base->interface_ptr->rpl_root) : info->pan_information.test_pan_size;
     struct ws_ie_custom *ie_custom;
     bool has_ie_custom_wp = false;
     int ie_offset;
-    uint8_t plf;
-
-    if (info->pan_information.jm.mask & (1 << WS_JM_PLF)) {
-        plf = MIN(100 * pan_size / info->pan_information.max_pan_size, 100);
-        if (plf != info->pan_information.jm.plf) {
-            info->pan_information.jm.plf = plf;
-            info->pan_information.jm.version++;
-        }
-    }
 
     if (wh_ies->fc)
-        ws_wh_fc_write(&msg->ie_buf_header, 50, 255);
+        ws_wh_fc_write(ie_buf_header, 50, 255);
     if (wh_ies->utt)
-        ws_wh_utt_write(&msg->ie_buf_header, msg->message_type);
+        ws_wh_utt_write(ie_buf_header, frame_type);
     if (wh_ies->bt)
-        ws_wh_bt_write(&msg->ie_buf_header);
+        ws_wh_bt_write(ie_buf_header);
     if (wh_ies->ea)
-        ws_wh_ea_write(&msg->ie_buf_header, base->interface_ptr->rcp->eui64);
+        ws_wh_ea_write(ie_buf_header, base->interface_ptr->rcp->eui64);
     if (wh_ies->lutt)
-        ws_wh_lutt_write(&msg->ie_buf_header, msg->message_type);
+        ws_wh_lutt_write(ie_buf_header, frame_type);
     if (wh_ies->lbt)
-        ws_wh_lbt_write(&msg->ie_buf_header);
+        ws_wh_lbt_write(ie_buf_header);
     if (wh_ies->nr)
         // TODO: Provide clock drift and timing accuracy
         // TODO: Make the LFN listening interval configurable (currently it is 5s-4.66h)
-        ws_wh_nr_write(&msg->ie_buf_header, WS_NR_ROLE_BR, 255, 0, 5000, 1680000);
+        ws_wh_nr_write(ie_buf_header, WS_NR_ROLE_BR, 255, 0, 5000, 1680000);
     if (wh_ies->lus)
-        ws_wh_lus_write(&msg->ie_buf_header, base->ie_params.lfn_us);
+        ws_wh_lus_write(ie_buf_header, base->ie_params.lfn_us);
     if (wh_ies->flus)
         // Only a single chan plan tag is supported. (0)
-        ws_wh_flus_write(&msg->ie_buf_header, info->fhss_config.uc_dwell_interval, 0);
+        ws_wh_flus_write(ie_buf_header, info->fhss_config.uc_dwell_interval, 0);
     if (wh_ies->lbs)
         // Only a single chan plan tag is supported. (0)
         // TODO: use a separate LFN BSI
-        ws_wh_lbs_write(&msg->ie_buf_header, info->fhss_config.lfn_bc_interval,
+        ws_wh_lbs_write(ie_buf_header, info->fhss_config.lfn_bc_interval,
                         info->fhss_config.bsi, 0,
                         info->fhss_config.lfn_bc_sync_period);
     if (wh_ies->lnd)
-        ws_wh_lnd_write(&msg->ie_buf_header, base->ie_params.lfn_network_discovery);
+        ws_wh_lnd_write(ie_buf_header, base->ie_params.lfn_network_discovery);
     if (wh_ies->lto)
-        ws_wh_lto_write(&msg->ie_buf_header, base->ie_params.lfn_timing->offset,
+        ws_wh_lto_write(ie_buf_header, base->ie_params.lfn_timing->offset,
                         base->ie_params.lfn_timing->adjusted_listening_interval);
     if (wh_ies->panid)
-        ws_wh_panid_write(&msg->ie_buf_header, info->pan_information.pan_id);
+        ws_wh_panid_write(ie_buf_header, info->pan_information.pan_id);
     if (wh_ies->lbc)
-        ws_wh_lbc_write(&msg->ie_buf_header, info->fhss_config.lfn_bc_interval,
+        ws_wh_lbc_write(ie_buf_header, info->fhss_config.lfn_bc_interval,
                         info->fhss_config.lfn_bc_sync_period);
     SLIST_FOREACH(ie_custom, &info->ie_custom_list, link) {
-        if (!(ie_custom->frame_type_mask & (1 << msg->message_type)))
+        if (!(ie_custom->frame_type_mask & (1 << frame_type)))
             continue;
         if (ie_custom->ie_type == WS_IE_CUSTOM_TYPE_HEADER)
-            iobuf_push_data(&msg->ie_buf_header, ie_custom->buf.data, ie_custom->buf.len);
+            iobuf_push_data(ie_buf_header, ie_custom->buf.data, ie_custom->buf.len);
         else
             has_ie_custom_wp = true;
     }
-    msg->ie_iov_header.iov_base = msg->ie_buf_header.data;
-    msg->ie_iov_header.iov_len = msg->ie_buf_header.len;
-    msg->ie_ext.headerIeVectorList = &msg->ie_iov_header;
-    msg->ie_ext.headerIovLength = 1;
 
     if (!ws_wp_ie_is_empty(wp_ies) || has_ie_custom_wp) {
-        ie_offset = ieee802154_ie_push_payload(&msg->ie_buf_payload, IEEE802154_IE_ID_WP);
+        ie_offset = ieee802154_ie_push_payload(ie_buf_payload, IEEE802154_IE_ID_WP);
         if (wp_ies->us)
-            ws_wp_nested_us_write(&msg->ie_buf_payload, &info->phy_config,
+            ws_wp_nested_us_write(ie_buf_payload, &info->phy_config,
                                   &base->interface_ptr->ws_info.fhss_config);
         if (wp_ies->bs)
-            ws_wp_nested_bs_write(&msg->ie_buf_payload, &info->phy_config,
+            ws_wp_nested_bs_write(ie_buf_payload, &info->phy_config,
                                   &base->interface_ptr->ws_info.fhss_config);
         if (wp_ies->pan)
-            ws_wp_nested_pan_write(&msg->ie_buf_payload, pan_size,
+            ws_wp_nested_pan_write(ie_buf_payload, pan_size,
                                    info->pan_information.routing_cost, info->pan_information.version);
         if (wp_ies->netname)
-            ws_wp_nested_netname_write(&msg->ie_buf_payload, info->network_name);
+            ws_wp_nested_netname_write(ie_buf_payload, info->network_name);
         if (wp_ies->panver)
-            ws_wp_nested_panver_write(&msg->ie_buf_payload, info->pan_information.pan_version);
+            ws_wp_nested_panver_write(ie_buf_payload, info->pan_information.pan_version);
         if (wp_ies->gtkhash)
-            ws_wp_nested_gtkhash_write(&msg->ie_buf_payload, ws_pae_controller_gtk_hash_ptr_get(base->interface_ptr));
+            ws_wp_nested_gtkhash_write(ie_buf_payload, ws_pae_controller_gtk_hash_ptr_get(base->interface_ptr));
         if (wp_ies->pom)
-            ws_wp_nested_pom_write(&msg->ie_buf_payload, info->phy_config.phy_op_modes, true);
+            ws_wp_nested_pom_write(ie_buf_payload, info->phy_config.phy_op_modes, true);
         if (wp_ies->lcp)
             // Only unicast schedule using tag 0 is supported
-            ws_wp_nested_lcp_write(&msg->ie_buf_payload, 0, &base->interface_ptr->ws_info.phy_config,
+            ws_wp_nested_lcp_write(ie_buf_payload, 0, &base->interface_ptr->ws_info.phy_config,
                                    &base->interface_ptr->ws_info.fhss_config);
         if (wp_ies->lfnver)
-            ws_wp_nested_lfnver_write(&msg->ie_buf_payload, info->pan_information.lfn_version);
+            ws_wp_nested_lfnver_write(ie_buf_payload, info->pan_information.lfn_version);
         if (wp_ies->lgtkhash)
-            ws_wp_nested_lgtkhash_write(&msg->ie_buf_payload, ws_pae_controller_lgtk_hash_ptr_get(base->interface_ptr),
+            ws_wp_nested_lgtkhash_write(ie_buf_payload, ws_pae_controller_lgtk_hash_ptr_get(base->interface_ptr),
                                         ws_pae_controller_lgtk_active_index_get(base->interface_ptr));
         if (wp_ies->lbats)
-            ws_wp_nested_lbats_write(&msg->ie_buf_payload, base->ie_params.lbats_ie);
+            ws_wp_nested_lbats_write(ie_buf_payload, base->ie_params.lbats_ie);
         if (wp_ies->jm)
-            ws_wp_nested_jm_write(&msg->ie_buf_payload, &info->pan_information.jm);
+            ws_wp_nested_jm_write(ie_buf_payload, &info->pan_information.jm);
         SLIST_FOREACH(ie_custom, &info->ie_custom_list, link)
-            if (ie_custom->frame_type_mask & (1 << msg->message_type) &&
+            if (ie_custom->frame_type_mask & (1 << frame_type) &&
                 ie_custom->ie_type != WS_IE_CUSTOM_TYPE_HEADER)
-                iobuf_push_data(&msg->ie_buf_payload, ie_custom->buf.data, ie_custom->buf.len);
-        ieee802154_ie_fill_len_payload(&msg->ie_buf_payload, ie_offset);
+                iobuf_push_data(ie_buf_payload, ie_custom->buf.data, ie_custom->buf.len);
+        ieee802154_ie_fill_len_payload(ie_buf_payload, ie_offset);
+    }
+}
+
+static void ws_llc_ie_cache_key_fill(llc_data_base_t *base, uint16_t pan_size,
+                                     const struct wh_ie_list *wh_ies,
+                                     const struct wp_ie_list *wp_ies,
+                                     struct llc_ie_cache_key *key)
+{
+    struct ws_info *info = &base->interface_ptr->ws_info;
+    gtkhash_t *gtkhash;
+
+    // Zeroed so padding does not prevent memcmp() from matching
+    memset(key, 0, sizeof(*key));
+    key->wh_ies          = *wh_ies;
+    key->wp_ies          = *wp_ies;
+    key->pan_size        = pan_size;
+    key->routing_cost    = info->pan_information.routing_cost;
+    key->pan_version     = info->pan_information.pan_version;
+    key->lfn_version     = info->pan_information.lfn_version;
+    key->fan_tps_version = info->pan_information.version;
+    key->jm              = info->pan_information.jm;
+    key->pan_id          = info->pan_information.pan_id;
+    if (wp_ies->gtkhash) {
+        gtkhash = ws_pae_controller_gtk_hash_ptr_get(base->interface_ptr);
+        memcpy(key->gtkhash, gtkhash, sizeof(key->gtkhash));
+    }
+    if (wp_ies->lgtkhash) {
+        gtkhash = ws_pae_controller_lgtk_hash_ptr_get(base->interface_ptr);
+        memcpy(key->lgtkhash, gtkhash, sizeof(key->lgtkhash));
+        key->lgtk_index = ws_pae_controller_lgtk_active_index_get(base->interface_ptr);
+    }
+}
+
+/*
+ * Most IEs only change on configuration or key events, so the IEs built for
+ * each frame type are kept and copied as long as their content is unchanged.
+ * The UTT-IE and BT-IE timing fields are filled by the RCP, so they do not
+ * need to be patched. IEs using per-message parameters are always rebuilt.
+ */
+static void ws_llc_prepare_ie(llc_data_base_t *base, llc_message_t *msg,
+                              const struct wh_ie_list *wh_ies,
+                              const struct wp_ie_list *wp_ies)
+{
+    struct ws_info *info = &base->interface_ptr->ws_info;
+    uint16_t pan_size = (info->pan_information.test_pan_size == -1) ?
+                         rpl_target_count(&base->interface_ptr->rpl_root) : info->pan_information.test_pan_size;
+    struct llc_ie_cache *cache = &base->ie_cache[msg->message_type];
+    struct llc_ie_cache_key key;
+    uint8_t plf;
+
+    if (info->pan_information.jm.mask & (1 << WS_JM_PLF)) {
+        plf = MIN(100 * pan_size / info->pan_information.max_pan_size, 100);
+        if (plf != info->pan_information.jm.plf) {
+            info->pan_information.jm.plf = plf;
+            info->pan_information.jm.version++;
+        }
     }
+
+    if (wh_ies->lus || wh_ies->lnd || wh_ies->lto || wp_ies->lbats) {
+        ws_llc_write_ie(base, msg->message_type, pan_size, wh_ies, wp_ies,
+                        &msg->ie_buf_header, &msg->ie_buf_payload);
+    } else {
+        ws_llc_ie_cache_key_fill(base, pan_size, wh_ies, wp_ies, &key);
+        if (!cache->valid || memcmp(&cache->key, &key, sizeof(key))) {
+            cache->ie_buf_header.len  = 0;
+            cache->ie_buf_payload.len = 0;
+            ws_llc_write_ie(base, msg->message_type, pan_size, wh_ies, wp_ies,
+                            &cache->ie_buf_header, &cache->ie_buf_payload);
+            cache->key   = key;
+            cache->valid = true;
+        }
+        iobuf_push_data(&msg->ie_buf_header, cache->ie_buf_header.data, cache->ie_buf_header.len);
+        iobuf_push_data(&msg->ie_buf_payload, cache->ie_buf_payload.data, cache->ie_buf_payload.len);
+    }
+
+    msg->ie_iov_header.iov_base = msg->ie_buf_header.data;
+    msg->ie_iov_header.iov_len = msg->ie_buf_header.len;
+    msg->ie_ext.headerIeVectorList = &msg->ie_iov_header;
+    msg->ie_ext.headerIovLength = 1;
     msg->ie_iov_payload[0].iov_len = msg->ie_buf_payload.len;
     msg->ie_iov_payload[0].iov_base = msg->ie_buf_payload.data;
     msg->ie_ext.payloadIeVectorList = &msg->ie_iov_payload[0];
     msg->ie_ext.payloadIovLength = 1;
 }
 
+void ws_llc_ie_cache_invalidate(struct net_if *interface)
+{
+    llc_data_base_t *base = ws_llc_discover_by_interface(interface);
+
+    if (!base)
+        return;
+    for (int i = 0; i < ARRAY_SIZE(base->ie_cache); i++)
+        base->ie_cache[i].valid = false;
+}
+
 static uint16_t ws_mpx_header_size_get(llc_data_base_t *base, uint16_t user_id)
 {
     //TODO add IEEE802154_IE_ID_WP support
@@ -1624,6 +1729,8 @@ static void ws_llc_clean(llc_data_base_t *base)
     base->temp_entries.llc_eap_pending_list_size = 0;
     base->temp_entries.active_eapol_session = false;
     memset(&base->ie_params, 0, sizeof(llc_ie_params_t));
+    for (int i = 0; i < ARRAY_SIZE(base->ie_cache); i++)
+        base->ie_cache[i].valid = false;
 
     //Disable High Priority mode
     base->high_priority_mode = false;
@@ -1700,6 +1807,10 @@ int8_t ws_llc_delete(struct net_if *interface)
 
     ws_llc_clean(base);
 
+    for (int i = 0; i < ARRAY_SIZE(base->ie_cache); i++) {
+        iobuf_free(&base->ie_cache[i].ie_buf_header);
+        iobuf_free(&base->ie_cache[i].ie_buf_payload);
+    }
     ns_list_remove(&llc_data_base_list, base);
     free(base);
     return 0;
@@ -129,6 +129,9 @@ int8_t ws_llc_set_mode_switch(struct net_if *interface, uint8_t mode, uint8_t ph
 
 int ws_llc_set_edfe(struct net_if *interface, enum ws_edfe_mode mode, uint8_t *neighbor_mac_address);
 
+// Force the IEs to be rebuilt, to be called when their content is modified
+void ws_llc_ie_cache_invalidate(struct net_if *interface);
+
 const char *tr_ws_frame(uint8_t frame_type);
 
 typedef struct mcps_data_cnf         mcps_data_cnf_t;
@@ -290,7 +290,7 @@ static void ws_mngt_lpa_schedule(struct net_if *net_if, struct ws_lnd_ie *ie_lnd
     // slots is used instead (if any).
     memcpy(net_if->ws_info.mngt.lpa_dst, eui64, 8);
     // Start timer
-    g_timers[WS_TIMER_LPA].timeout = timeout / WS_TIMER_GLOBAL_PERIOD_MS;
+    ws_timer_start_timeout(WS_TIMER_LPA, timeout);
 }
 
 void ws_mngt_lpas_analyze(struct net_if *net_if,
@@ -307,7 +307,7 @@ void ws_mngt_lpas_analyze(struct net_if *net_if,
     struct ws_nr_ie ie_nr;
     bool add_neighbor;
 
-    if (g_timers[WS_TIMER_LPA].timeout) {
+    if (g_timers[WS_TIMER_LPA].expire_tick) {
         TRACE(TR_DROP, "drop %-9s: LPA already queued for %s",
               tr_ws_frame(WS_FT_LPAS), tr_eui64(net_if->ws_info.mngt.lpa_dst));
         return;
@@ -40,6 +40,16 @@
 
 #define LFN_SCHEDULE_GUARD_TIME_MS 300
 
+static const void *ws_neigh_index_key(const void *entry)
+{
+    return ((const struct ws_neigh *)entry)->mac64;
+}
+
+static const struct hash_table_type ws_neigh_index_type = {
+    .key     = ws_neigh_index_key,
+    .key_len = 8,
+};
+
 struct ws_neigh *ws_neigh_add(struct ws_neigh_table *table,
                          const uint8_t mac64[8],
                          uint8_t role, int8_t tx_power_dbm,
@@ -64,19 +74,14 @@ struct ws_neigh *ws_neigh_add(struct ws_neigh_table *table,
     neigh->apc_txpow_dbm = tx_power_dbm;
     neigh->apc_txpow_dbm_ofdm = tx_power_dbm;
     SLIST_INSERT_HEAD(&table->neigh_list, neigh, link);
+    hash_table_insert(&table->neigh_index, &ws_neigh_index_type, neigh);
     TRACE(TR_NEIGH_15_4, "15.4 neighbor add %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
     return neigh;
 }
 
 struct ws_neigh *ws_neigh_get(struct ws_neigh_table *table, const uint8_t *mac64)
 {
-    struct ws_neigh *neigh;
-
-    SLIST_FOREACH(neigh, &table->neigh_list, link)
-        if (!memcmp(neigh->mac64, mac64, 8))
-            return neigh;
-
-    return NULL;
+    return hash_table_get(&table->neigh_index, &ws_neigh_index_type, mac64);
 }
 
 void ws_neigh_del(struct ws_neigh_table *table, const uint8_t *mac64)
@@ -84,6 +89,7 @@ void ws_neigh_del(struct ws_neigh_table *table, const uint8_t *mac64)
     struct ws_neigh *neigh = ws_neigh_get(table, mac64);
 
     if (neigh) {
+        hash_table_remove(&table->neigh_index, &ws_neigh_index_type, neigh);
         SLIST_REMOVE(&table->neigh_list, neigh, ws_neigh, link);
         TRACE(TR_NEIGH_15_4, "15.4 neighbor del %s / %ds", tr_eui64(neigh->mac64), neigh->lifetime_s);
         free(neigh);
@@ -103,7 +109,7 @@ void ws_neigh_table_expire(struct ws_neigh_table *table, int time_update)
 
 size_t ws_neigh_get_neigh_count(struct ws_neigh_table *table)
 {
-    return SLIST_SIZE(&table->neigh_list, link);
+    return table->neigh_index.count;
 }
 
 static void ws_neigh_calculate_ufsi_drift(struct fhss_ws_neighbor_timing_info *fhss_data, uint24_t ufsi,
@@ -22,6 +22,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <time.h>
+#include "common/hash_table.h"
 #include "common/int24.h"
 
 #include "6lbr/ws/ws_ie_lib.h"
@@ -132,6 +133,9 @@ SLIST_HEAD(ws_neigh_list, ws_neigh);
  */
 struct ws_neigh_table {
     struct ws_neigh_list neigh_list;
+    // Index over neigh_list keyed on the EUI-64, so ws_neigh_get() does not
+    // need to walk the list.
+    struct hash_table neigh_index;
     void (*on_expire)(const uint8_t *mac64);              /*!< Neighbor Remove Callback notify */
 };
 
@@ -21,7 +21,6 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
-#include <glob.h>
 #include <fnmatch.h>
 #include <inttypes.h>
 #include "common/log.h"
@@ -56,8 +55,8 @@ bool ws_pae_key_storage_supp_delete(const void *instance, const uint8_t *eui64)
     if (!g_storage_prefix)
         return true;
     str_key(eui64, 8, str_buf, sizeof(str_buf));
-    snprintf(filename, sizeof(filename), "%skeys-%s", g_storage_prefix, str_buf);
-    ret = unlink(filename);
+    snprintf(filename, sizeof(filename), "keys-%s", str_buf);
+    ret = storage_unlink(filename);
 
     return !ret;
 }
@@ -184,23 +183,17 @@ supp_entry_t *ws_pae_key_storage_supp_read(const void *instance, const uint8_t *
 
 int ws_pae_key_storage_list(uint8_t eui64[][8], int len)
 {
-    char filename[PATH_MAX];
-    glob_t globbuf;
-    int i, ret;
+    char **filenames;
+    int i;
 
     if (!g_storage_prefix) {
         WARN("storage disabled, cannot retrieve EUI64");
         return 0;
     }
-    snprintf(filename, sizeof(filename), "%skeys-*:*:*:*:*:*:*:*", g_storage_prefix);
-    ret = glob(filename, 0, NULL, &globbuf);
-    if (ret) {
-        WARN_ON(ret != GLOB_NOMATCH, "glob %s returned an error", filename);
-        return 0;
-    }
-    for (i = 0; globbuf.gl_pathv[i] && i < len; i++)
-        parse_byte_array(eui64[i], 8, strrchr(globbuf.gl_pathv[i], '-') + 1);
-    globfree(&globbuf);
+    filenames = storage_glob("keys-*:*:*:*:*:*:*:*");
+    for (i = 0; filenames[i] && i < len; i++)
+        parse_byte_array(eui64[i], 8, strrchr(filenames[i], '-') + 1);
+    storage_glob_free(filenames);
     return i;
 }
 
@@ -208,12 +201,10 @@ bool ws_pae_key_storage_supp_exists(const uint8_t eui64[8])
 {
     char eui64_str[STR_MAX_LEN_EUI64];
     char filename[PATH_MAX];
-    int ret;
 
     str_eui64(eui64, eui64_str);
-    ret = snprintf(filename, sizeof(filename), "%skeys-%s", g_storage_prefix, eui64_str);
-    BUG_ON(ret >= sizeof(filename), "g_storage_prefix too big");
-    return !access(filename, F_OK);
+    snprintf(filename, sizeof(filename), "keys-%s", eui64_str);
+    return storage_exists(filename);
 }
 
 uint16_t ws_pae_key_storage_storing_interval_get(void)
@@ -20,9 +20,12 @@
 #include "bus_uart.h"
 
 struct slist;
+struct iovec;
 
 struct bus {
     int  (*tx)(struct bus *bus, const void *buf, unsigned int len);
+    // Optional, allows to send a frame without gathering it first
+    int  (*txv)(struct bus *bus, const struct iovec *iov, int iovcnt);
     int  (*rx)(struct bus *bus, void *buf, unsigned int len);
 
     int     fd;
@@ -24,6 +24,7 @@
 #include "common/iobuf.h"
 #include "common/crc.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 #include "common/memutils.h"
 #include "common/bus.h"
 #include "common/hif.h"
@@ -88,91 +89,135 @@ int uart_open(const char *device, int bitrate, bool hardflow)
     return fd;
 }
 
+static uint8_t uart_rx_byte(const struct bus *bus, int offset)
+{
+    return bus->uart.rx_buf[(bus->uart.rx_buf_start + offset) % sizeof(bus->uart.rx_buf)];
+}
+
+// Copy len bytes from offset in the RX ring.
+static void uart_rx_copy(const struct bus *bus, void *out, int offset, int len)
+{
+    int start = (bus->uart.rx_buf_start + offset) % sizeof(bus->uart.rx_buf);
+    int chunk = MIN(len, (int)sizeof(bus->uart.rx_buf) - start);
+
+    memcpy(out, bus->uart.rx_buf + start, chunk);
+    memcpy((uint8_t *)out + chunk, bus->uart.rx_buf, len - chunk);
+}
+
+static void uart_rx_consume(struct bus *bus, int len)
+{
+    BUG_ON(len > bus->uart.rx_buf_len);
+    bus->uart.rx_buf_len -= len;
+    if (bus->uart.rx_buf_len)
+        bus->uart.rx_buf_start = (bus->uart.rx_buf_start + len) % sizeof(bus->uart.rx_buf);
+    else
+        bus->uart.rx_buf_start = 0;
+}
+
 static void uart_read(struct bus *bus)
 {
+    int end = (bus->uart.rx_buf_start + bus->uart.rx_buf_len) % sizeof(bus->uart.rx_buf);
+    size_t room;
     ssize_t size;
 
-    size = read(bus->fd,
-                bus->uart.rx_buf + bus->uart.rx_buf_len,
-                sizeof(bus->uart.rx_buf) - bus->uart.rx_buf_len);
+    // Only the contiguous free space is filled, the remaining will be read on
+    // the next call.
+    if (end < bus->uart.rx_buf_start || bus->uart.rx_buf_len == sizeof(bus->uart.rx_buf))
+        room = bus->uart.rx_buf_start - end;
+    else
+        room = sizeof(bus->uart.rx_buf) - end;
+    size = read(bus->fd, bus->uart.rx_buf + end, room);
     FATAL_ON(size < 0, 2, "%s: read: %m", __func__);
     FATAL_ON(!size, 2, "%s: read: Empty read", __func__);
     TRACE(TR_BUS, "bus rx: %s (%zd bytes)",
-          tr_bytes(bus->uart.rx_buf + bus->uart.rx_buf_len,
+          tr_bytes(bus->uart.rx_buf + end,
                    size, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR), size);
     bus->uart.rx_buf_len += size;
 }
 
-int uart_tx(struct bus *bus, const void *buf, unsigned int buf_len)
+int uart_txv(struct bus *bus, const struct iovec *iov, int iovcnt)
 {
+    struct iovec iov_uart[UART_TXV_IOV_MAX + 2];
     uint8_t hdr[4], fcs[2];
-    const struct iovec iov[] = {
-        { .iov_base = hdr,         .iov_len = sizeof(hdr) },
-        { .iov_base = (void *)buf, .iov_len = buf_len     },
-        { .iov_base = fcs,         .iov_len = sizeof(fcs) },
-    };
+    size_t buf_len = 0;
+    uint16_t crc;
     ssize_t ret;
 
+    BUG_ON(iovcnt > UART_TXV_IOV_MAX);
+    crc = CRC_INIT_FCS;
+    for (int i = 0; i < iovcnt; i++) {
+        crc = crc16(crc, iov[i].iov_base, iov[i].iov_len);
+        buf_len += iov[i].iov_len;
+        iov_uart[i + 1] = iov[i];
+    }
     BUG_ON(buf_len > FIELD_MAX(UART_HDR_LEN_MASK));
     write_le16(hdr,     buf_len);
     write_le16(hdr + 2, crc16(CRC_INIT_HCS, hdr, 2));
-    write_le16(fcs,     crc16(CRC_INIT_FCS, buf, buf_len));
+    write_le16(fcs,     crc);
+    iov_uart[0].iov_base = hdr;
+    iov_uart[0].iov_len  = sizeof(hdr);
+    iov_uart[iovcnt + 1].iov_base = fcs;
+    iov_uart[iovcnt + 1].iov_len  = sizeof(fcs);
 
-    ret = writev(bus->fd, iov, ARRAY_SIZE(iov));
+    ret = writev(bus->fd, iov_uart, iovcnt + 2);
     FATAL_ON(ret < 0, 2, "%s: write: %m", __func__);
     if (ret != sizeof(hdr) + buf_len + sizeof(fcs))
         FATAL(2 ,"%s: write: Short write", __func__);
 
-    TRACE(TR_BUS, "bus tx: %s %s %02x %02x (%zd bytes)",
+    TRACE(TR_BUS, "bus tx: %s %s%s %02x %02x (%zd bytes)",
           tr_bytes(hdr, sizeof(hdr), NULL, 128, DELIM_SPACE | ELLIPSIS_STAR),
-          tr_bytes(buf, buf_len,     NULL, 128, DELIM_SPACE | ELLIPSIS_STAR),
-          fcs[0], fcs[1], sizeof(hdr) + buf_len + sizeof(fcs));
+          tr_bytes(iov[0].iov_base, iov[0].iov_len, NULL, 128, DELIM_SPACE | ELLIPSIS_STAR),
+          iovcnt > 1 ? " ..." : "", fcs[0], fcs[1], sizeof(hdr) + buf_len + sizeof(fcs));
 
     return ret;
 }
 
+int uart_tx(struct bus *bus, const void *buf, unsigned int buf_len)
+{
+    const struct iovec iov = { .iov_base = (void *)buf, .iov_len = buf_len };
+
+    return uart_txv(bus, &iov, 1);
+}
+
 int uart_rx(struct bus *bus, void *buf, unsigned int buf_len)
 {
-    struct iobuf_read iobuf = { };
-    const uint8_t *hdr;
-    uint16_t len, fcs;
+    uint8_t hdr[4], fcs[2];
+    int dropped = 0;
+    uint16_t len;
 
     if (!bus->uart.data_ready)
         uart_read(bus);
     bus->uart.data_ready = false;
-    iobuf.data      = bus->uart.rx_buf;
-    iobuf.data_size = bus->uart.rx_buf_len;
-    hdr = iobuf_pop_data_ptr(&iobuf, 4);
-    if (iobuf.err)
-        return 0;
-    if (!crc_check(CRC_INIT_HCS, hdr, 2, read_le16(hdr + 2))) {
-        memmove(bus->uart.rx_buf, bus->uart.rx_buf + 1, bus->uart.rx_buf_len - 1);
-        bus->uart.rx_buf_len -= 1;
-        bus->uart.data_ready = true;
-        if (bus->uart.init_phase)
-            TRACE(TR_DROP, "drop %-9s: bad hcs", "uart");
-        else
+    // Resynchronize on the next valid header
+    while (bus->uart.rx_buf_len >= sizeof(hdr)) {
+        uart_rx_copy(bus, hdr, 0, sizeof(hdr));
+        if (crc_check(CRC_INIT_HCS, hdr, 2, read_le16(hdr + 2)))
+            break;
+        if (!bus->uart.init_phase)
             FATAL(3, "%s: bad hcs", __func__);
-        return 0;
+        uart_rx_consume(bus, 1);
+        dropped++;
     }
+    if (dropped)
+        TRACE(TR_DROP, "drop %-9s: bad hcs (%d bytes)", "uart", dropped);
+    if (bus->uart.rx_buf_len < sizeof(hdr))
+        return 0;
     len = FIELD_GET(UART_HDR_LEN_MASK, read_le16(hdr));
     BUG_ON(buf_len < len);
-    iobuf_pop_data(&iobuf, buf, len);
-    fcs = iobuf_pop_le16(&iobuf);
-    if (iobuf.err)
+    if (bus->uart.rx_buf_len < sizeof(hdr) + len + sizeof(fcs))
         return 0; // Frame not fully received
+    uart_rx_copy(bus, buf, sizeof(hdr), len);
+    uart_rx_copy(bus, fcs, sizeof(hdr) + len, sizeof(fcs));
     bus->uart.data_ready = true;
-    if (!crc_check(CRC_INIT_FCS, buf, len, fcs)) {
-        memmove(bus->uart.rx_buf, bus->uart.rx_buf + 1, bus->uart.rx_buf_len - 1);
-        bus->uart.rx_buf_len -= 1;
+    if (!crc_check(CRC_INIT_FCS, buf, len, read_le16(fcs))) {
+        uart_rx_consume(bus, 1);
         if (bus->uart.init_phase)
             TRACE(TR_DROP, "drop %-9s: bad fcs", "uart");
         else
             FATAL(3, "%s: bad fcs", __func__);
         return 0;
     }
-    memmove(bus->uart.rx_buf, iobuf_ptr(&iobuf), iobuf_remaining_size(&iobuf));
-    bus->uart.rx_buf_len = iobuf_remaining_size(&iobuf);
+    uart_rx_consume(bus, sizeof(hdr) + len + sizeof(fcs));
     return len;
 }
 
@@ -234,10 +279,10 @@ static size_t uart_legacy_rx_hdlc(struct bus *bus, uint8_t *buf, size_t buf_len)
         uart_read(bus);
 
     i = 0;
-    while (bus->uart.rx_buf[i] == 0x7E && i < bus->uart.rx_buf_len)
+    while (i < bus->uart.rx_buf_len && uart_rx_byte(bus, i) == 0x7E)
         i++;
     frame_start = i;
-    while (bus->uart.rx_buf[i] != 0x7E && i < bus->uart.rx_buf_len)
+    while (i < bus->uart.rx_buf_len && uart_rx_byte(bus, i) != 0x7E)
         i++;
     frame_len = i - frame_start + 1;
     if (bus->uart.init_phase && i >= bus->uart.rx_buf_len)
@@ -247,17 +292,16 @@ static size_t uart_legacy_rx_hdlc(struct bus *bus, uint8_t *buf, size_t buf_len)
         return 0;
 
     BUG_ON(buf_len < frame_len);
-    memcpy(buf, bus->uart.rx_buf + frame_start, frame_len);
+    uart_rx_copy(bus, buf, frame_start, frame_len);
 
-    while (bus->uart.rx_buf[i] == 0x7E && i < bus->uart.rx_buf_len)
+    while (i < bus->uart.rx_buf_len && uart_rx_byte(bus, i) == 0x7E)
         i++;
-    memmove(bus->uart.rx_buf, bus->uart.rx_buf + i, bus->uart.rx_buf_len - i);
-    bus->uart.rx_buf_len -= i;
+    uart_rx_consume(bus, i);
 
     i = 0;
     bus->uart.data_ready = false;
     while (i < bus->uart.rx_buf_len) {
-        if (bus->uart.rx_buf[i] == 0x7E) {
+        if (uart_rx_byte(bus, i) == 0x7E) {
             bus->uart.data_ready = true;
             break;
         }
@@ -319,6 +363,7 @@ bool uart_detect_v2(struct bus *bus)
         .fd = bus->fd,
         .events = POLLIN,
     };
+    uint8_t hdr[4];
     int ret;
 
     ret = poll(&pfd, 1, 10000);
@@ -332,10 +377,11 @@ bool uart_detect_v2(struct bus *bus)
             return false;
         uart_read(bus);
         bus->uart.data_ready = true;
-        for (int i = 0; i < bus->uart.rx_buf_len - 4; i++)
-            if (crc_check(CRC_INIT_HCS, bus->uart.rx_buf + i, 2,
-                          read_le16(bus->uart.rx_buf + i + 2)))
+        for (int i = 0; i < bus->uart.rx_buf_len - 4; i++) {
+            uart_rx_copy(bus, hdr, i, sizeof(hdr));
+            if (crc_check(CRC_INIT_HCS, hdr, 2, read_le16(hdr + 2)))
                 return true;
+        }
     }
 }
 
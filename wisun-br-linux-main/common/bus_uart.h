@@ -18,11 +18,15 @@
 #include <stdint.h>
 
 struct bus;
+struct iovec;
 
 #define UART_HDR_LEN_MASK 0x07ff
+#define UART_TXV_IOV_MAX  4
 
+// rx_buf is a ring buffer of rx_buf_len bytes starting at rx_buf_start
 struct bus_uart {
     bool    data_ready;
+    int     rx_buf_start;
     int     rx_buf_len;
     uint8_t rx_buf[2048];
     bool    init_phase;
@@ -31,6 +35,9 @@ struct bus_uart {
 int uart_open(const char *device, int bitrate, bool hardflow);
 
 int uart_tx(struct bus *bus, const void *buf, unsigned int len);
+// Same as uart_tx(), but the payload is gathered from up to UART_TXV_IOV_MAX
+// buffers.
+int uart_txv(struct bus *bus, const struct iovec *iov, int iovcnt);
 int uart_rx(struct bus *bus, void *buf, unsigned int len);
 
 int uart_legacy_tx(struct bus *bus, const void *buf, unsigned int len);
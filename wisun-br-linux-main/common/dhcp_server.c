@@ -333,7 +333,7 @@ static int dhcp_handle_request(struct dhcp_server *dhcp,
     return 0;
 }
 
-void dhcp_recv(struct dhcp_server *dhcp)
+bool dhcp_recv(struct dhcp_server *dhcp)
 {
     socklen_t src_addr_len = sizeof(struct sockaddr_in6);
     struct sockaddr_in6 src_addr;
@@ -344,9 +344,12 @@ void dhcp_recv(struct dhcp_server *dhcp)
     req.data = buf;
     req.data_size = xrecvfrom(dhcp->fd, buf, sizeof(buf), 0,
                               (struct sockaddr *)&src_addr, &src_addr_len);
+    if (req.data_size < 0 && errno == EAGAIN)
+        return false;
+    FATAL_ON(req.data_size < 0, 2, "%s: recvfrom: %m", __func__);
     if (src_addr.sin6_family != AF_INET6) {
         TRACE(TR_DROP, "drop %-9s: not IPv6", "dhcp");
-        return;
+        return true;
     }
     TRACE(TR_DHCP, "rx-dhcp %-9s src:%s",
           val_to_str(req.data[0], dhcp_frames, "[UNK]"),
@@ -354,6 +357,7 @@ void dhcp_recv(struct dhcp_server *dhcp)
     if (!dhcp_handle_request(dhcp, &req, &reply))
         dhcp_send_reply(dhcp, &src_addr, &reply);
     iobuf_free(&reply);
+    return true;
 }
 
 void dhcp_start(struct dhcp_server *dhcp, const char *tun_dev, uint8_t *hwaddr, uint8_t *prefix)
@@ -13,6 +13,7 @@
  */
 #ifndef DHCP_SERVER_H
 #define DHCP_SERVER_H
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -24,7 +25,8 @@
  *
  * Once started, the caller has to poll (with poll() or equivalent)
  * dhcp_server->fd for any incoming frames. dhcp_recv() has to be called
- * dhcp_server->fd is ready.
+ * dhcp_server->fd is ready. If dhcp_server->fd is non-blocking, dhcp_recv()
+ * returns false once there is nothing left to read.
  */
 
 #define DHCPV6_SERVER_PORT 547
@@ -40,6 +42,6 @@ struct dhcp_server {
 };
 
 void dhcp_start(struct dhcp_server *dhcp, const char *tun_dev, uint8_t *hwaddr, uint8_t *prefix);
-void dhcp_recv(struct dhcp_server *dhcp);
+bool dhcp_recv(struct dhcp_server *dhcp);
 
 #endif
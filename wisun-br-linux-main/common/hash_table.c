@@ -0,0 +1,108 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/fnv_hash.h"
+#include "common/mathutils.h"
+#include "common/memutils.h"
+#include "common/log.h"
+
+#include "hash_table.h"
+
+#define HASH_TABLE_SIZE_MIN 64
+
+static size_t hash_table_slot(const struct hash_table *table, const struct hash_table_type *type,
+                              const void *key)
+{
+    return fnv_hash_reverse_32_init(key, type->key_len) & (table->size - 1);
+}
+
+void *hash_table_get(const struct hash_table *table, const struct hash_table_type *type,
+                     const void *key)
+{
+    void *entry;
+    size_t i;
+
+    if (!table->count)
+        return NULL;
+    for (i = hash_table_slot(table, type, key); (entry = table->slots[i]); i = (i + 1) & (table->size - 1))
+        if (!memcmp(type->key(entry), key, type->key_len))
+            return entry;
+    return NULL;
+}
+
+static void hash_table_link(struct hash_table *table, const struct hash_table_type *type,
+                            void *entry)
+{
+    size_t i = hash_table_slot(table, type, type->key(entry));
+
+    while (table->slots[i])
+        i = (i + 1) & (table->size - 1);
+    table->slots[i] = entry;
+}
+
+static void hash_table_grow(struct hash_table *table, const struct hash_table_type *type)
+{
+    void **slots = table->slots;
+    size_t size = table->size;
+
+    table->size = MAX(table->size * 2, HASH_TABLE_SIZE_MIN);
+    table->slots = zalloc(table->size * sizeof(*table->slots));
+    for (size_t i = 0; i < size; i++)
+        if (slots[i])
+            hash_table_link(table, type, slots[i]);
+    free(slots);
+}
+
+void hash_table_insert(struct hash_table *table, const struct hash_table_type *type,
+                       void *entry)
+{
+    BUG_ON(!entry);
+    if ((table->count + 1) * 2 > table->size)
+        hash_table_grow(table, type);
+    hash_table_link(table, type, entry);
+    table->count++;
+}
+
+void hash_table_remove(struct hash_table *table, const struct hash_table_type *type,
+                       const void *entry)
+{
+    size_t mask = table->size - 1;
+    size_t i, j, k;
+
+    if (!table->count)
+        return;
+    for (i = hash_table_slot(table, type, type->key(entry)); table->slots[i] != entry; i = (i + 1) & mask)
+        if (!table->slots[i])
+            return;
+    // Backward shift deletion: move up any entry whose probe sequence went
+    // through the freed slot, so lookups can stop at the first empty slot.
+    for (j = (i + 1) & mask; table->slots[j]; j = (j + 1) & mask) {
+        k = hash_table_slot(table, type, type->key(table->slots[j]));
+        if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+            table->slots[i] = table->slots[j];
+            i = j;
+        }
+    }
+    table->slots[i] = NULL;
+    table->count--;
+}
+
+void hash_table_clear(struct hash_table *table)
+{
+    if (table->slots)
+        memset(table->slots, 0, table->size * sizeof(*table->slots));
+    table->count = 0;
+}
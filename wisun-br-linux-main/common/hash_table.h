@@ -0,0 +1,59 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+#include <stddef.h>
+
+/*
+ * Open addressing hash table (linear probing) of pointers to entries stored
+ * by the caller. Each entry embeds its key, a fixed length byte string
+ * returned by the key() callback of the table type. Keys are hashed with
+ * FNV-1a and compared with memcmp().
+ *
+ * The table grows to keep its load factor below 1/2. Removals use backward
+ * shift deletion, so lookups can stop at the first empty slot and no
+ * tombstone is needed.
+ *
+ * A zero-initialized table is empty and valid. The table type is passed to
+ * each call, so tables embedded in statically initialized structures do not
+ * need a setup step.
+ */
+
+struct hash_table_type {
+    const void *(*key)(const void *entry);
+    size_t key_len;
+};
+
+struct hash_table {
+    void **slots;
+    size_t size;  // Always a power of 2, or 0
+    size_t count;
+};
+
+void *hash_table_get(const struct hash_table *table, const struct hash_table_type *type,
+                     const void *key);
+// The key of entry must not be already present in the table.
+void hash_table_insert(struct hash_table *table, const struct hash_table_type *type,
+                       void *entry);
+// Does nothing if entry is not in the table.
+void hash_table_remove(struct hash_table *table, const struct hash_table_type *type,
+                       const void *entry);
+// Remove all the entries. The entries themselves are not freed.
+void hash_table_clear(struct hash_table *table);
+
+#define hash_table_foreach(table, entry, i) \
+    for (size_t i = 0; i < (table)->size; i++) \
+        if (((entry) = (table)->slots[i]))
+
+#endif
@@ -11,6 +11,7 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <string.h>
 #include <errno.h>
 
 #include "common/bits.h"
@@ -167,3 +168,101 @@ int ieee802154_ie_find_nested(const uint8_t *data, size_t len, uint8_t id, struc
     }
     return -ENOENT;
 }
+
+static void ieee802154_ie_index_add(struct ieee802154_ie_index *index, uint8_t key,
+                                    const uint8_t *content, uint16_t len)
+{
+    if (index->entries[key].offset)
+        return;
+    index->entries[key].offset = content - index->data;
+    index->entries[key].len    = len;
+}
+
+void ieee802154_ie_index_header(struct ieee802154_ie_index *index, const uint8_t *data, size_t len, uint8_t id)
+{
+    struct iobuf_read input = {
+        .data_size = len,
+        .data = data,
+    };
+    const uint8_t *ie_data;
+    uint16_t ie_hdr;
+    int ie_len;
+
+    memset(index, 0, sizeof(*index));
+    index->data = data;
+    index->len  = len;
+    while (iobuf_remaining_size(&input)) {
+        ie_hdr = iobuf_pop_le16(&input);
+        if (FIELD_GET(IEEE802154_IE_TYPE_MASK, ie_hdr) != IEEE802154_IE_TYPE_HEADER)
+            return;
+        ie_len  = FIELD_GET(IEEE802154_IE_HEADER_LEN_MASK, ie_hdr);
+        ie_data = iobuf_pop_data_ptr(&input, ie_len);
+        if (!ie_data)
+            return;
+        if (FIELD_GET(IEEE802154_IE_HEADER_ID_MASK, ie_hdr) != id)
+            continue;
+        // Consider the list malformed if there is no first byte to index
+        if (!ie_len)
+            return;
+        ieee802154_ie_index_add(index, ie_data[0], ie_data, ie_len);
+    }
+}
+
+void ieee802154_ie_index_nested(struct ieee802154_ie_index *index, const uint8_t *data, size_t len)
+{
+    struct iobuf_read input = {
+        .data_size = len,
+        .data = data,
+    };
+    const uint8_t *ie_data;
+    bool ie_is_long;
+    uint16_t ie_hdr;
+    uint8_t ie_id;
+    int ie_len;
+
+    memset(index, 0, sizeof(*index));
+    index->data = data;
+    index->len  = len;
+    while (iobuf_remaining_size(&input)) {
+        ie_hdr = iobuf_pop_le16(&input);
+        ie_is_long = FIELD_GET(IEEE802154_IE_TYPE_MASK, ie_hdr) == IEEE802154_IE_TYPE_NESTED_LONG;
+        if (ie_is_long) {
+            ie_len = FIELD_GET(IEEE802154_IE_NESTED_LONG_LEN_MASK, ie_hdr);
+            ie_id  = FIELD_GET(IEEE802154_IE_NESTED_LONG_ID_MASK,  ie_hdr);
+        } else {
+            ie_len = FIELD_GET(IEEE802154_IE_NESTED_SHORT_LEN_MASK, ie_hdr);
+            ie_id  = FIELD_GET(IEEE802154_IE_NESTED_SHORT_ID_MASK,  ie_hdr);
+        }
+        ie_data = iobuf_pop_data_ptr(&input, ie_len);
+        if (!ie_data)
+            return;
+        // Short IDs use 7 bits, long IDs are stored in the upper half
+        ieee802154_ie_index_add(index, ie_is_long ? 0x80 | ie_id : ie_id, ie_data, ie_len);
+    }
+}
+
+static int ieee802154_ie_index_find(const struct ieee802154_ie_index *index, uint8_t key,
+                                    struct iobuf_read *ie_content)
+{
+    memset(ie_content, 0, sizeof(struct iobuf_read));
+    if (!index->entries[key].offset) {
+        ie_content->err = true;
+        return -ENOENT;
+    }
+    ie_content->data      = index->data + index->entries[key].offset;
+    ie_content->data_size = index->entries[key].len;
+    return ie_content->data_size;
+}
+
+int ieee802154_ie_index_find_header(const struct ieee802154_ie_index *index, uint8_t subid,
+                                    struct iobuf_read *ie_content)
+{
+    return ieee802154_ie_index_find(index, subid, ie_content);
+}
+
+int ieee802154_ie_index_find_nested(const struct ieee802154_ie_index *index, uint8_t id,
+                                    struct iobuf_read *ie_content, bool is_long)
+{
+    BUG_ON(is_long && id > FIELD_MAX(IEEE802154_IE_NESTED_LONG_ID_MASK));
+    return ieee802154_ie_index_find(index, is_long ? 0x80 | id : id, ie_content);
+}
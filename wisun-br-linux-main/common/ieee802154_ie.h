@@ -62,4 +62,34 @@ int ieee802154_ie_find_header(const uint8_t *data, size_t len, uint8_t id, struc
 int ieee802154_ie_find_payload(const uint8_t *data, size_t len, uint8_t id, struct iobuf_read *ie_content);
 int ieee802154_ie_find_nested(const uint8_t *data, size_t len, uint8_t id, struct iobuf_read *ie_content, bool is_long);
 
+/*
+ * An IE index is built with a single pass over an IE list, lookups are then
+ * done in constant time instead of rescanning the list for every IE. Like
+ * ieee802154_ie_find_*(), only the first occurrence of an IE is returned, and
+ * the IEs located after a malformed one are not found.
+ *
+ * ieee802154_ie_index_header() indexes the header IEs using the given element
+ * ID by their first content byte (ie. the sub-ID for Wi-SUN WH-IEs). The
+ * content returned by ieee802154_ie_index_find_header() still starts with
+ * this byte.
+ *
+ * ieee802154_ie_index_nested() indexes the content of a payload IE by nested
+ * IE ID.
+ */
+struct ieee802154_ie_index {
+    const uint8_t *data;
+    size_t len;
+    struct {
+        uint16_t offset; // 0 if not found, the content never starts at 0
+        uint16_t len;
+    } entries[256];
+};
+
+void ieee802154_ie_index_header(struct ieee802154_ie_index *index, const uint8_t *data, size_t len, uint8_t id);
+void ieee802154_ie_index_nested(struct ieee802154_ie_index *index, const uint8_t *data, size_t len);
+int ieee802154_ie_index_find_header(const struct ieee802154_ie_index *index, uint8_t subid,
+                                    struct iobuf_read *ie_content);
+int ieee802154_ie_index_find_nested(const struct ieee802154_ie_index *index, uint8_t id,
+                                    struct iobuf_read *ie_content, bool is_long);
+
 #endif
@@ -14,24 +14,604 @@
 #define _GNU_SOURCE
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <libgen.h>
 #include <errno.h>
+#include <fnmatch.h>
 #include <glob.h>
+#include <sys/stat.h>
 
+#include "common/endian.h"
+#include "common/fnv_hash.h"
+#include "common/iobuf.h"
 #include "common/log.h"
+#include "common/mathutils.h"
 #include "common/memutils.h"
 
 #include "key_value_storage.h"
 
+#define STORAGE_LOG_SCHEME "log:"
+#define STORAGE_INDEX_SIZE_MIN 64
+// Do not bother compacting small logs
+#define STORAGE_LOG_COMPACT_MIN (64 * 1024)
+
+#define STORAGE_SNAPSHOT_NAME     "snapshot"
+#define STORAGE_SNAPSHOT_MAGIC    0x50414e53 // "SNAP"
+#define STORAGE_SNAPSHOT_VERSION  1
+#define STORAGE_SNAPSHOT_PERIOD_S 300
+
+/*
+ * Once storage_init() has been called, the content of all the stored files is
+ * kept in a table of records and reads are served from memory.
+ *
+ * With the files backend, written records are queued in a dirty list and
+ * written to their files by storage_flush(), so the main loop writes a record
+ * once per iteration whatever the number of times it was updated. The records
+ * are also dumped in a binary snapshot at exit and every STORAGE_SNAPSHOT_PERIOD_S
+ * if they changed, so the next start does not need to open every file. The
+ * snapshot is deleted on the first change after it has been written, so it is
+ * missing after a crash and the text files are read instead. It is also
+ * ignored if the files were edited, added or removed after it was written.
+ *
+ * With the log backend, the log is a sequence of records:
+ *   "+<name> <len>\n" followed by <len> bytes of data and "\n"
+ *   "-<name>\n" for a deletion
+ */
+struct storage_record {
+    char *name;
+    char *data;                     // NULL if deleted, until the next log sync
+    size_t len;
+    bool dirty;
+    struct storage_record *next;    // next record in the same bucket
+    struct storage_record *dirty_next; // files backend only
+};
+
+static struct {
+    struct storage_record **index;  // NULL before storage_init()
+    size_t index_size;              // always a power of 2
+    size_t count;
+    int sync_timer_s;
+    bool exiting;                   // storage_sync() called from atexit()
+    // Log backend
+    char log_path[PATH_MAX];
+    FILE *log_file;                 // NULL for the files backend
+    size_t log_len;
+    size_t live_len;                // size of the compacted log
+    int sync_interval_s;
+    bool log_dirty;
+    // Files backend
+    struct storage_record *dirty;   // records waiting for storage_flush()
+    bool snapshot_on_disk;
+    bool snapshot_dirty;
+} g_storage;
+
 const char *g_storage_prefix = NULL;
 
+// Write errors are fatal, except at exit where calling exit() again is
+// undefined: the error is reported and the write abandoned.
+#define STORAGE_ERROR_ON(COND, ...) ({                               \
+    bool __ret = (COND);                                             \
+    if (__ret && !g_storage.exiting)                                 \
+        FATAL(2, __VA_ARGS__);                                       \
+    if (__ret)                                                       \
+        WARN(__VA_ARGS__);                                           \
+    __ret;                                                           \
+})
+
+static size_t storage_log_record_len(const struct storage_record *record)
+{
+    if (!record->data)
+        return strlen(record->name) + 2;
+    return snprintf(NULL, 0, "+%s %zu\n", record->name, record->len) + record->len + 1;
+}
+
+static struct storage_record **storage_record_bucket(const char *name)
+{
+    uint32_t hash = fnv_hash_reverse_32_init((const uint8_t *)name, strlen(name));
+
+    return &g_storage.index[hash & (g_storage.index_size - 1)];
+}
+
+static struct storage_record *storage_record_get(const char *name)
+{
+    struct storage_record *record;
+
+    for (record = *storage_record_bucket(name); record; record = record->next)
+        if (!strcmp(record->name, name))
+            return record;
+    return NULL;
+}
+
+static struct storage_record *storage_record_new(const char *name)
+{
+    struct storage_record **index, **bucket;
+    struct storage_record *record, *next;
+    size_t index_size;
+
+    if (g_storage.count + 1 > g_storage.index_size) {
+        index = g_storage.index;
+        index_size = g_storage.index_size;
+        g_storage.index_size = MAX(index_size * 2, STORAGE_INDEX_SIZE_MIN);
+        g_storage.index = zalloc(g_storage.index_size * sizeof(struct storage_record *));
+        for (size_t i = 0; i < index_size; i++) {
+            for (record = index[i]; record; record = next) {
+                next = record->next;
+                bucket = storage_record_bucket(record->name);
+                record->next = *bucket;
+                *bucket = record;
+            }
+        }
+        free(index);
+    }
+    record = zalloc(sizeof(struct storage_record));
+    record->name = strdup(name);
+    FATAL_ON(!record->name, 2, "%s: strdup: %m", __func__);
+    bucket = storage_record_bucket(name);
+    record->next = *bucket;
+    *bucket = record;
+    g_storage.count++;
+    return record;
+}
+
+static void storage_record_free(struct storage_record *record)
+{
+    struct storage_record **ptr;
+
+    for (ptr = storage_record_bucket(record->name); *ptr != record; ptr = &(*ptr)->next)
+        ;
+    *ptr = record->next;
+    if (record->dirty && !g_storage.log_file) {
+        for (ptr = &g_storage.dirty; *ptr != record; ptr = &(*ptr)->dirty_next)
+            ;
+        *ptr = record->dirty_next;
+    }
+    g_storage.count--;
+    free(record->name);
+    free(record->data);
+    free(record);
+}
+
+// Take ownership of data. A NULL data deletes the record.
+static void storage_record_set(const char *name, char *data, size_t len)
+{
+    struct storage_record *record = storage_record_get(name);
+
+    if (!record && !data)
+        return;
+    if (!record)
+        record = storage_record_new(name);
+    if (record->data)
+        g_storage.live_len -= storage_log_record_len(record);
+    free(record->data);
+    record->data = data;
+    record->len = len;
+    if (record->data)
+        g_storage.live_len += storage_log_record_len(record);
+    if (g_storage.log_file) {
+        record->dirty = true;
+        g_storage.log_dirty = true;
+    } else if (!data) {
+        storage_record_free(record);
+    }
+}
+
+static void storage_record_mark_dirty(const char *name)
+{
+    struct storage_record *record = storage_record_get(name);
+
+    if (g_storage.log_file || record->dirty)
+        return;
+    record->dirty = true;
+    record->dirty_next = g_storage.dirty;
+    g_storage.dirty = record;
+}
+
+static void storage_record_clear(void)
+{
+    for (size_t i = 0; i < g_storage.index_size; i++)
+        while (g_storage.index[i])
+            storage_record_free(g_storage.index[i]);
+    g_storage.live_len = 0;
+}
+
+static char *storage_read_file(const char *path, size_t *len)
+{
+    char chunk[4096];
+    char *data;
+    FILE *file;
+    FILE *mem;
+    size_t ret;
+
+    file = fopen(path, "r");
+    if (!file)
+        return NULL;
+    mem = open_memstream(&data, len);
+    FATAL_ON(!mem, 2, "%s: open_memstream: %m", __func__);
+    while ((ret = fread(chunk, 1, sizeof(chunk), file)))
+        fwrite(chunk, 1, ret, mem);
+    fclose(mem);
+    if (ferror(file)) {
+        WARN("%s: read %s: %m", __func__, path);
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+static int storage_fsync(FILE *file, const char *path)
+{
+    if (STORAGE_ERROR_ON(fflush(file), "%s: fflush %s: %m", __func__, path) ||
+        STORAGE_ERROR_ON(fsync(fileno(file)), "%s: fsync %s: %m", __func__, path))
+        return -1;
+    return 0;
+}
+
+static size_t storage_log_write(FILE *file, const struct storage_record *record)
+{
+    if (!record->data)
+        return fprintf(file, "-%s\n", record->name);
+    fprintf(file, "+%s %zu\n", record->name, record->len);
+    fwrite(record->data, 1, record->len, file);
+    fputc('\n', file);
+    return storage_log_record_len(record);
+}
+
+static void storage_log_compact(void)
+{
+    struct storage_record *record;
+    char path[PATH_MAX + 4];
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s.tmp", g_storage.log_path);
+    file = fopen(path, "w");
+    FATAL_ON(!file, 2, "%s: fopen %s: %m", __func__, path);
+    for (size_t i = 0; i < g_storage.index_size; i++)
+        for (record = g_storage.index[i]; record; record = record->next)
+            if (record->data)
+                storage_log_write(file, record);
+    storage_fsync(file, path);
+    fclose(file);
+    FATAL_ON(rename(path, g_storage.log_path), 2, "%s: rename %s: %m", __func__, path);
+    if (g_storage.log_file)
+        fclose(g_storage.log_file);
+    g_storage.log_file = fopen(g_storage.log_path, "a");
+    FATAL_ON(!g_storage.log_file, 2, "%s: fopen %s: %m", __func__, g_storage.log_path);
+    g_storage.log_len = g_storage.live_len;
+}
+
+static void storage_log_load(void)
+{
+    size_t line_size = 0;
+    char *line = NULL;
+    char *data, *sep;
+    ssize_t len;
+    size_t size;
+    FILE *file;
+
+    file = fopen(g_storage.log_path, "r");
+    if (!file && errno == ENOENT)
+        return;
+    FATAL_ON(!file, 2, "%s: fopen %s: %m", __func__, g_storage.log_path);
+    while ((len = getline(&line, &line_size, file)) > 0) {
+        if (line[len - 1] != '\n')
+            break;
+        line[len - 1] = '\0';
+        if (line[0] == '-') {
+            storage_record_set(line + 1, NULL, 0);
+            continue;
+        }
+        sep = strrchr(line, ' ');
+        if (line[0] != '+' || !sep)
+            break;
+        *sep = '\0';
+        size = strtoul(sep + 1, NULL, 10);
+        data = xalloc(size + 1);
+        if (fread(data, 1, size + 1, file) != size + 1 || data[size] != '\n') {
+            free(data);
+            break;
+        }
+        data[size] = '\0';
+        storage_record_set(line + 1, data, size);
+    }
+    // A truncated record is expected if the daemon was killed during a sync
+    WARN_ON(!feof(file), "%s: dropping corrupted end of log", g_storage.log_path);
+    free(line);
+    fclose(file);
+}
+
+static void storage_log_sync(void)
+{
+    struct storage_record *record, *next;
+
+    if (!g_storage.log_dirty)
+        return;
+
+    // Dirty records are batched in the stdio buffer and synced at once
+    for (size_t i = 0; i < g_storage.index_size; i++) {
+        for (record = g_storage.index[i]; record; record = next) {
+            next = record->next;
+            if (!record->dirty)
+                continue;
+            g_storage.log_len += storage_log_write(g_storage.log_file, record);
+            record->dirty = false;
+            if (!record->data)
+                storage_record_free(record);
+        }
+    }
+    if (storage_fsync(g_storage.log_file, g_storage.log_path))
+        return;
+    g_storage.log_dirty = false;
+
+    // The log is compacted anyway by the next storage_init()
+    if (!g_storage.exiting && g_storage.log_len > STORAGE_LOG_COMPACT_MIN &&
+        g_storage.log_len > 2 * g_storage.live_len)
+        storage_log_compact();
+}
+
+static void storage_snapshot_invalidate(void)
+{
+    char path[PATH_MAX];
+
+    g_storage.snapshot_dirty = true;
+    if (!g_storage.snapshot_on_disk)
+        return;
+    snprintf(path, sizeof(path), "%s%s", g_storage_prefix, STORAGE_SNAPSHOT_NAME);
+    if (unlink(path) < 0 && errno != ENOENT)
+        WARN("unlink %s: %m", path);
+    g_storage.snapshot_on_disk = false;
+}
+
+/*
+ *   le32 magic, u8 version, le32 record count
+ *   for each record: le16 name length, name, le32 data length, data
+ *   le32 FNV hash of all the above
+ */
+static void storage_snapshot_write(void)
+{
+    struct iobuf_write buf = { };
+    struct storage_record *record;
+    char tmp_path[PATH_MAX + 4];
+    char path[PATH_MAX];
+    FILE *file;
+
+    iobuf_push_le32(&buf, STORAGE_SNAPSHOT_MAGIC);
+    iobuf_push_u8(&buf, STORAGE_SNAPSHOT_VERSION);
+    iobuf_push_le32(&buf, g_storage.count);
+    for (size_t i = 0; i < g_storage.index_size; i++) {
+        for (record = g_storage.index[i]; record; record = record->next) {
+            iobuf_push_le16(&buf, strlen(record->name));
+            iobuf_push_data(&buf, record->name, strlen(record->name));
+            iobuf_push_le32(&buf, record->len);
+            iobuf_push_data(&buf, record->data, record->len);
+        }
+    }
+    iobuf_push_le32(&buf, fnv_hash_reverse_32_init(buf.data, buf.len));
+
+    snprintf(path, sizeof(path), "%s%s", g_storage_prefix, STORAGE_SNAPSHOT_NAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    file = fopen(tmp_path, "w");
+    if (!file) {
+        WARN("%s: fopen %s: %m", __func__, tmp_path);
+        iobuf_free(&buf);
+        return;
+    }
+    fwrite(buf.data, 1, buf.len, file);
+    iobuf_free(&buf);
+    if (storage_fsync(file, tmp_path)) {
+        fclose(file);
+        return;
+    }
+    fclose(file);
+    if (STORAGE_ERROR_ON(rename(tmp_path, path), "%s: rename %s: %m", __func__, tmp_path))
+        return;
+    g_storage.snapshot_on_disk = true;
+    g_storage.snapshot_dirty = false;
+}
+
+// Detect text files edited outside of the daemon since the snapshot was written
+static bool storage_snapshot_is_stale(const struct timespec *snapshot_mtime, const char *files[])
+{
+    struct storage_record *record;
+    char path[PATH_MAX];
+    char pattern[PATH_MAX];
+    glob_t globbuf;
+    struct stat st;
+    bool stale = false;
+
+    for (size_t i = 0; i < g_storage.index_size; i++) {
+        for (record = g_storage.index[i]; record; record = record->next) {
+            snprintf(path, sizeof(path), "%s%s", g_storage_prefix, record->name);
+            if (stat(path, &st) < 0)
+                return true;
+            if (st.st_mtim.tv_sec > snapshot_mtime->tv_sec ||
+                (st.st_mtim.tv_sec == snapshot_mtime->tv_sec &&
+                 st.st_mtim.tv_nsec > snapshot_mtime->tv_nsec))
+                return true;
+        }
+    }
+    for (; *files && !stale; files++) {
+        snprintf(pattern, sizeof(pattern), "%s%s", g_storage_prefix, *files);
+        if (glob(pattern, 0, NULL, &globbuf))
+            continue;
+        for (int i = 0; globbuf.gl_pathv[i] && !stale; i++)
+            if (!storage_record_get(globbuf.gl_pathv[i] + strlen(g_storage_prefix)))
+                stale = true;
+        globfree(&globbuf);
+    }
+    return stale;
+}
+
+static bool storage_snapshot_load(const char *files[])
+{
+    struct iobuf_read buf = { };
+    const uint8_t *name, *data;
+    char name_buf[PATH_MAX];
+    char path[PATH_MAX];
+    uint32_t count, len;
+    uint16_t name_len;
+    char *content, *copy;
+    struct stat st;
+    size_t size;
+
+    snprintf(path, sizeof(path), "%s%s", g_storage_prefix, STORAGE_SNAPSHOT_NAME);
+    if (stat(path, &st) < 0)
+        return false;
+    content = storage_read_file(path, &size);
+    if (!content)
+        return false;
+    buf.data = (const uint8_t *)content;
+    buf.data_size = size;
+    if (size < 13 || iobuf_pop_le32(&buf) != STORAGE_SNAPSHOT_MAGIC ||
+        iobuf_pop_u8(&buf) != STORAGE_SNAPSHOT_VERSION ||
+        fnv_hash_reverse_32_init(buf.data, size - 4) != read_le32(buf.data + size - 4)) {
+        WARN("%s: invalid snapshot", path);
+        free(content);
+        return false;
+    }
+    buf.data_size = size - 4;
+    count = iobuf_pop_le32(&buf);
+    for (uint32_t i = 0; i < count; i++) {
+        name_len = iobuf_pop_le16(&buf);
+        name = iobuf_pop_data_ptr(&buf, name_len);
+        len = iobuf_pop_le32(&buf);
+        data = iobuf_pop_data_ptr(&buf, len);
+        if (buf.err || name_len >= sizeof(name_buf)) {
+            buf.err = true;
+            break;
+        }
+        memcpy(name_buf, name, name_len);
+        name_buf[name_len] = '\0';
+        copy = xalloc(len + 1);
+        memcpy(copy, data, len);
+        copy[len] = '\0';
+        storage_record_set(name_buf, copy, len);
+    }
+    free(content);
+    if (buf.err || iobuf_remaining_size(&buf)) {
+        WARN("%s: invalid snapshot", path);
+        storage_record_clear();
+        return false;
+    }
+    if (storage_snapshot_is_stale(&st.st_mtim, files)) {
+        INFO("%s: stored files changed, ignoring the snapshot", path);
+        storage_record_clear();
+        if (unlink(path) < 0)
+            WARN("unlink %s: %m", path);
+        return false;
+    }
+    g_storage.snapshot_on_disk = true;
+    return true;
+}
+
+static void storage_files_load(const char *files[])
+{
+    char pattern[PATH_MAX];
+    glob_t globbuf;
+    char *data;
+    size_t len;
+    int ret;
+
+    for (; *files; files++) {
+        snprintf(pattern, sizeof(pattern), "%s%s", g_storage_prefix, *files);
+        ret = glob(pattern, 0, NULL, &globbuf);
+        if (ret) {
+            WARN_ON(ret != GLOB_NOMATCH, "glob %s returned an error", pattern);
+            continue;
+        }
+        for (int i = 0; globbuf.gl_pathv[i]; i++) {
+            data = storage_read_file(globbuf.gl_pathv[i], &len);
+            if (data)
+                storage_record_set(globbuf.gl_pathv[i] + strlen(g_storage_prefix), data, len);
+        }
+        globfree(&globbuf);
+    }
+    g_storage.snapshot_dirty = true;
+}
+
+static void storage_exit(void)
+{
+    g_storage.exiting = true;
+    storage_sync();
+}
+
+void storage_init(const char *storage_prefix, int sync_interval_s, const char *files[])
+{
+    g_storage_prefix = storage_prefix;
+    g_storage.index_size = STORAGE_INDEX_SIZE_MIN;
+    g_storage.index = zalloc(g_storage.index_size * sizeof(struct storage_record *));
+    g_storage.sync_interval_s = sync_interval_s;
+    if (!strncmp(storage_prefix, STORAGE_LOG_SCHEME, strlen(STORAGE_LOG_SCHEME))) {
+        snprintf(g_storage.log_path, sizeof(g_storage.log_path), "%s",
+                 storage_prefix + strlen(STORAGE_LOG_SCHEME));
+        storage_log_load();
+        storage_log_compact();
+        g_storage.sync_timer_s = sync_interval_s;
+    } else {
+        if (!storage_snapshot_load(files))
+            storage_files_load(files);
+        g_storage.sync_timer_s = STORAGE_SNAPSHOT_PERIOD_S;
+    }
+    atexit(storage_exit);
+}
+
+void storage_flush(void)
+{
+    struct storage_record *record;
+    char path[PATH_MAX];
+    FILE *file;
+
+    if (!g_storage.dirty)
+        return;
+    storage_snapshot_invalidate();
+    for (record = g_storage.dirty; record; record = record->dirty_next) {
+        record->dirty = false;
+        snprintf(path, sizeof(path), "%s%s", g_storage_prefix, record->name);
+        file = fopen(path, "w");
+        if (!file) {
+            WARN("%s: fopen %s: %m", __func__, path);
+            continue;
+        }
+        fwrite(record->data, 1, record->len, file);
+        if (fclose(file))
+            WARN("%s: write %s: %m", __func__, path);
+    }
+    g_storage.dirty = NULL;
+}
+
+void storage_sync(void)
+{
+    if (!g_storage.index)
+        return;
+    storage_flush();
+    if (g_storage.log_file)
+        storage_log_sync();
+    else if (g_storage.snapshot_dirty)
+        storage_snapshot_write();
+}
+
+void storage_timer(int seconds)
+{
+    if (!g_storage.index)
+        return;
+    g_storage.sync_timer_s -= seconds;
+    if (g_storage.sync_timer_s > 0)
+        return;
+    g_storage.sync_timer_s = g_storage.log_file ? g_storage.sync_interval_s : STORAGE_SNAPSHOT_PERIOD_S;
+    storage_sync();
+}
+
 int storage_check_access(const char *storage_prefix)
 {
     char *tmp;
 
     if (!storage_prefix || !strlen(storage_prefix))
         return 0;
+    if (!strncmp(storage_prefix, STORAGE_LOG_SCHEME, strlen(STORAGE_LOG_SCHEME))) {
+        tmp = strdupa(storage_prefix + strlen(STORAGE_LOG_SCHEME));
+        return access(dirname(tmp), W_OK);
+    }
     if (storage_prefix[strlen(storage_prefix) - 1] == '/') {
         return access(storage_prefix, W_OK);
     } else {
@@ -54,6 +634,33 @@ struct storage_parse_info *storage_open(const char *filename, const char *mode)
     return info;
 }
 
+static struct storage_parse_info *storage_record_open(const char *filename, const char *mode)
+{
+    struct storage_record *record = NULL;
+    struct storage_parse_info *info;
+
+    if (mode[0] == 'r') {
+        record = storage_record_get(filename);
+        if (!record || !record->data) {
+            errno = ENOENT;
+            return NULL;
+        }
+    }
+    info = zalloc(sizeof(struct storage_parse_info));
+    snprintf(info->filename, sizeof(info->filename), "%s", filename);
+    if (record) {
+        info->file = fmemopen(record->data, record->len, "r");
+    } else {
+        info->record_write = true;
+        info->file = open_memstream(&info->record_data, &info->record_len);
+    }
+    if (!info->file) {
+        free(info);
+        return NULL;
+    }
+    return info;
+}
+
 struct storage_parse_info *storage_open_prefix(const char *filename, const char *mode)
 {
     struct storage_parse_info *info;
@@ -61,6 +668,8 @@ struct storage_parse_info *storage_open_prefix(const char *filename, const char
 
     if (!g_storage_prefix)
         return NULL;
+    if (g_storage.index)
+        return storage_record_open(filename, mode);
     asprintf(&full_filename, "%s%s", g_storage_prefix, filename);
     info = storage_open(full_filename, mode);
     free(full_filename);
@@ -70,10 +679,18 @@ struct storage_parse_info *storage_open_prefix(const char *filename, const char
 int storage_close(struct storage_parse_info *info)
 {
     FILE *file;
+    int ret;
 
     BUG_ON(!info);
     BUG_ON(!info->file);
     file = info->file;
+    if (info->record_write) {
+        ret = fclose(file);
+        storage_record_set(info->filename, info->record_data, info->record_len);
+        storage_record_mark_dirty(info->filename);
+        free(info);
+        return ret;
+    }
     free(info);
     return fclose(file);
 }
@@ -129,6 +746,18 @@ void storage_delete(const char *files[])
     if (!g_storage_prefix)
         return;
 
+    if (g_storage.index)
+        for (const char **pattern = files; *pattern; pattern++)
+            for (size_t i = 0; i < g_storage.index_size; i++)
+                for (struct storage_record *record = g_storage.index[i], *next; record; record = next) {
+                    next = record->next;
+                    if (record->data && !fnmatch(*pattern, record->name, 0))
+                        storage_record_set(record->name, NULL, 0);
+                }
+    if (g_storage.log_file)
+        return;
+    storage_snapshot_invalidate();
+
     for (; *files; files++) {
         snprintf(filename, sizeof(filename), "%s%s", g_storage_prefix, *files);
         ret = glob(filename, 0, NULL, &globbuf);
@@ -145,3 +774,92 @@ void storage_delete(const char *files[])
         globfree(&globbuf);
     }
 }
+
+int storage_unlink(const char *filename)
+{
+    char full_filename[PATH_MAX];
+    struct storage_record *record;
+
+    if (!g_storage_prefix) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (g_storage.log_file) {
+        record = storage_record_get(filename);
+        if (!record || !record->data) {
+            errno = ENOENT;
+            return -1;
+        }
+        storage_record_set(filename, NULL, 0);
+        return 0;
+    }
+    if (g_storage.index) {
+        storage_record_set(filename, NULL, 0);
+        storage_snapshot_invalidate();
+    }
+    snprintf(full_filename, sizeof(full_filename), "%s%s", g_storage_prefix, filename);
+    return unlink(full_filename);
+}
+
+bool storage_exists(const char *filename)
+{
+    char full_filename[PATH_MAX];
+    struct storage_record *record;
+
+    if (!g_storage_prefix)
+        return false;
+    if (g_storage.index) {
+        record = storage_record_get(filename);
+        return record && record->data;
+    }
+    snprintf(full_filename, sizeof(full_filename), "%s%s", g_storage_prefix, filename);
+    return !access(full_filename, F_OK);
+}
+
+static int storage_glob_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+char **storage_glob(const char *pattern)
+{
+    char full_pattern[PATH_MAX];
+    struct storage_record *record;
+    char **filenames;
+    glob_t globbuf;
+    size_t n = 0;
+    int ret;
+
+    if (!g_storage_prefix)
+        return zalloc(sizeof(char *));
+
+    if (g_storage.index) {
+        filenames = zalloc((g_storage.count + 1) * sizeof(char *));
+        for (size_t i = 0; i < g_storage.index_size; i++)
+            for (record = g_storage.index[i]; record; record = record->next)
+                if (record->data && !fnmatch(pattern, record->name, 0))
+                    filenames[n++] = strdup(record->name);
+        // Same order as glob()
+        qsort(filenames, n, sizeof(char *), storage_glob_cmp);
+        return filenames;
+    }
+
+    snprintf(full_pattern, sizeof(full_pattern), "%s%s", g_storage_prefix, pattern);
+    ret = glob(full_pattern, 0, NULL, &globbuf);
+    if (ret) {
+        WARN_ON(ret != GLOB_NOMATCH, "glob %s returned an error", full_pattern);
+        return zalloc(sizeof(char *));
+    }
+    filenames = zalloc((globbuf.gl_pathc + 1) * sizeof(char *));
+    for (n = 0; n < globbuf.gl_pathc; n++)
+        filenames[n] = strdup(globbuf.gl_pathv[n] + strlen(g_storage_prefix));
+    globfree(&globbuf);
+    return filenames;
+}
+
+void storage_glob_free(char **filenames)
+{
+    for (int i = 0; filenames[i]; i++)
+        free(filenames[i]);
+    free(filenames);
+}
@@ -31,8 +31,27 @@
  * In addition, if storage_parse_line() detects a number under brackets (like in
  * "gtk[0]"), the value under bracket is placed in key_array_index (otherwise,
  * key_array_index value is UINT_MAX)
+ *
+ * If g_storage_prefix is in the form "log:<path>", the files are not written
+ * to the filesystem. They are kept in memory and persisted as records appended
+ * to the single file <path>. Dirty records are written and synced by
+ * storage_sync(), which is called every storage_init() interval from
+ * storage_timer(). The log is compacted when it becomes twice bigger than its
+ * live content.
+ *
+ * Otherwise, storage_init() loads all the files matching the patterns it is
+ * given in memory, from a binary snapshot "<prefix>snapshot" if it is valid or
+ * from the files themselves. Reads are then served from memory and the written
+ * files are saved by storage_flush(), which the main loop calls at the end of
+ * each iteration. The snapshot is rewritten by storage_sync() if needed,
+ * and removed as soon as a file is modified, so an unclean exit falls back on
+ * the files. A snapshot older than any of the files is also ignored.
+ *
+ * In both cases, the files must be accessed with the storage_*_prefix() style
+ * functions below (names relative to the prefix).
  */
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <limits.h>
 
@@ -43,15 +62,29 @@ struct storage_parse_info {
     char line[256];
     char key[256], value[256];
     unsigned int key_array_index;
+    // Set when a record of the storage is being written
+    bool record_write;
+    char *record_data;
+    size_t record_len;
 };
 
 extern const char *g_storage_prefix;
 
+void storage_init(const char *storage_prefix, int sync_interval_s, const char *files[]);
 int storage_check_access(const char *storage_prefix);
 struct storage_parse_info *storage_open(const char *filename, const char *mode);
 struct storage_parse_info *storage_open_prefix(const char *filename, const char *mode);
 int storage_close(struct storage_parse_info *file);
 int storage_parse_line(struct storage_parse_info *file);
 void storage_delete(const char *files[]);
+int storage_unlink(const char *filename);
+bool storage_exists(const char *filename);
+// Return a NULL terminated array of the files matching pattern, to be released
+// with storage_glob_free().
+char **storage_glob(const char *pattern);
+void storage_glob_free(char **filenames);
+void storage_flush(void);
+void storage_sync(void);
+void storage_timer(int seconds);
 
 #endif
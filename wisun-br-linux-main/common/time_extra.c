@@ -11,8 +11,11 @@
  *
  * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
  */
+#include <stdint.h>
 #include <time.h>
 
+#include "time_extra.h"
+
 time_t time_current(clockid_t clockid)
 {
     struct timespec tp;
@@ -29,6 +32,14 @@ time_t time_get_elapsed(clockid_t clockid, time_t start)
     return tp.tv_sec - start;
 }
 
+uint64_t time_now_ms(clockid_t clockid)
+{
+    struct timespec tp;
+
+    clock_gettime(clockid, &tp);
+    return (uint64_t)tp.tv_sec * 1000 + tp.tv_nsec / 1000000;
+}
+
 time_t time_get_storage_offset(void)
 {
     struct timespec tp_realtime, tp_monotonic;
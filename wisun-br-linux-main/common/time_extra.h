@@ -13,12 +13,15 @@
  */
 #ifndef TIME_EXTRA_H
 #define TIME_EXTRA_H
+#include <stdint.h>
 #include <time.h>
 
 time_t time_current(clockid_t clockid);
 
 time_t time_get_elapsed(clockid_t clockid, time_t start);
 
+uint64_t time_now_ms(clockid_t clockid);
+
 /*
  * We rely on monotonic clock everywhere. However, monotonic timestamps do
  * not survive to reboots. So timestamp stored on the disk must use realtime
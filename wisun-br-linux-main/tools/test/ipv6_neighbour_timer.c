@@ -0,0 +1,46 @@
+/*
+ * SPDX-License-Identifier: LicenseRef-MSLA
+ * Copyright (c) 2024 Silicon Laboratories Inc. (www.silabs.com)
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of the Silicon Labs Master Software License
+ * Agreement (MSLA) available at [1].  This software is distributed to you in
+ * Object Code format and/or Source Code format and is governed by the sections
+ * of the MSLA applicable to Object Code, Source Code and Modified Open Source
+ * Code. By using this software, you agree to the terms of the MSLA.
+ *
+ * [1]: https://www.silabs.com/about-us/legal/master-software-license-agreement
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "common/log.h"
+#include "net/protocol.h"
+#include "ipv6/ipv6_routing_table.h"
+
+// A neighbour moved from a state with a NUD timer to a state without one must
+// leave the timer heap with its timer stopped.
+int main(void)
+{
+    static const uint8_t addr[16] = { 0xfe, 0x80, [15] = 0x01 };
+    static struct net_if net_if;
+    ipv6_neighbour_cache_t *cache = &net_if.ipv6_neighbour_cache;
+    ipv6_neighbour_t *entry;
+
+    ipv6_neighbour_cache_init(cache, 0);
+    cache->reachable_time = 30000;
+    entry = ipv6_neighbour_create(cache, addr, NULL);
+    FATAL_ON(!entry, 1, "ipv6_neighbour_create() failed");
+
+    ipv6_neighbour_set_state(cache, entry, IP_NEIGHBOUR_REACHABLE);
+    FATAL_ON(!entry->timer, 1, "REACHABLE: timer not started");
+    FATAL_ON(cache->timer_heap.len != 1, 1, "REACHABLE: entry not in timer heap");
+
+    ipv6_neighbour_set_state(cache, entry, IP_NEIGHBOUR_STALE);
+    FATAL_ON(entry->timer, 1, "STALE: timer not stopped");
+    FATAL_ON(cache->timer_heap.len, 1, "STALE: entry still in timer heap");
+    FATAL_ON(entry->timer_heap_pos, 1, "STALE: stale timer heap position");
+
+    printf("ok\n");
+    return 0;
+}